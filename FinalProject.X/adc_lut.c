@@ -0,0 +1,54 @@
+/*
+ * File:   adc_lut.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Generated by tools/gen_adc_lut.py, do not edit.
+
+#include "header.h"
+
+#if ADC_LUT_SHIFT != 3
+#error "adc_lut.c is out of date, run tools/gen_adc_lut.py"
+#endif
+
+// IR sensor distance in 1/16 cm, one entry every 8 ADC codes
+const int adc_distance_lut[ADC_LUT_SIZE] = {
+     3744,  3553,  3370,  3195,  3028,  2869,  2717,  2572,
+     2434,  2303,  2178,  2060,  1947,  1840,  1739,  1643,
+     1552,  1467,  1385,  1309,  1237,  1169,  1105,  1045,
+      988,   935,   886,   839,   796,   755,   717,   682,
+      649,   618,   590,   564,   539,   516,   495,   476,
+      458,   441,   426,   412,   399,   387,   376,   365,
+      356,   347,   339,   331,   324,   317,   311,   305,
+      299,   294,   289,   284,   279,   275,   270,   266,
+      262,   258,   254,   251,   247,   244,   240,   237,
+      235,   232,   230,   228,   226,   225,   224,   223,
+      224,   224,   226,   228,   231,   235,   240,   246,
+      253,   261,   271,   282,   294,   309,   325,   343,
+      363,   385,   409,   436,   465,   497,   532,   569,
+      610,   654,   702,   753,   808,   867,   930,   997,
+     1069,  1146,  1227,  1313,  1405,  1503,  1606,  1714,
+     1830,  1951,  2079,  2214,  2356,  2505,  2662,  2826,
+     2999
+};
+
+// Battery voltage in centivolts, one entry every 8 ADC codes
+const int adc_battery_lut[ADC_LUT_SIZE] = {
+        0,     8,    15,    23,    31,    39,    46,    54,
+       62,    70,    77,    85,    93,   101,   108,   116,
+      124,   131,   139,   147,   155,   162,   170,   178,
+      186,   193,   201,   209,   217,   224,   232,   240,
+      248,   255,   263,   271,   278,   286,   294,   302,
+      309,   317,   325,   333,   340,   348,   356,   364,
+      371,   379,   387,   394,   402,   410,   418,   425,
+      433,   441,   449,   456,   464,   472,   480,   487,
+      495,   503,   510,   518,   526,   534,   541,   549,
+      557,   565,   572,   580,   588,   596,   603,   611,
+      619,   626,   634,   642,   650,   657,   665,   673,
+      681,   688,   696,   704,   712,   719,   727,   735,
+      742,   750,   758,   766,   773,   781,   789,   797,
+      804,   812,   820,   828,   835,   843,   851,   859,
+      866,   874,   882,   889,   897,   905,   913,   920,
+      928,   936,   944,   951,   959,   967,   975,   982,
+      990
+};
@@ -0,0 +1,226 @@
+/*
+ * File:   commands.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include <stddef.h>
+#include <limits.h>
+
+// Commands received on UART2. Each command is an entry of the commands table:
+// its type packed by MSG_KEY4/MSG_KEY5, the number of integer arguments with
+// their range, and the handler that applies them. The parser packs the type
+// of every message while receiving it, so dispatching is a hash lookup on an
+// integer, whatever the number of commands.
+//
+// Every message is answered with $MACK,<type>* when applied or with
+// $MNACK,<type>,<reason>* when rejected (COMMAND_ACK = 0 disables replies).
+
+#define COMMAND_ACK 1
+#define COMMAND_SLOTS 32      // Power of two, at least twice the number of commands
+
+// Reasons of a $MNACK
+#define NACK_UNKNOWN  1       // No command with this type
+#define NACK_ARGS     2       // Wrong number of arguments or not integers
+#define NACK_RANGE    3       // Argument out of range
+#define NACK_REJECTED 4       // Refused by the handler
+
+typedef struct {
+    unsigned long key;
+    int n_args;
+    int min[MSG_MAX_FIELDS];
+    int max[MSG_MAX_FIELDS];
+    int (*handler)(const int* args);  // Returns 0 or the reason of the NACK
+} command;
+
+// $PCTH,<minth>,<maxth>*: distance thresholds of the control law in cm
+static int cmd_thresholds(const int* args){
+    if (args[0] >= args[1])
+        return NACK_REJECTED;
+    control_data.MINTH = args[0];
+    control_data.MAXTH = args[1];
+    return 0;
+}
+
+// $PSTT,<state>*: 0 waits for start, 1 moves (same as the button)
+static int cmd_state(const int* args){
+    control_data.state = args[0] ? Moving : WaitForStart;
+    return 0;
+}
+
+// $PGAIN,<surge_gain>,<yaw_scale>*: gains of the control law
+static int cmd_gains(const int* args){
+    control_data.surge_gain = args[0];
+    control_data.yaw_scale = args[1];
+    return 0;
+}
+
+// $PTLM,<mode>*: 0 ASCII telemetry, 1 binary telemetry
+static int cmd_telemetry(const int* args){
+    telemetry_mode = args[0];
+    return 0;
+}
+
+// $PRATE,<task>,<period_ms>*: period of a scheduler task (index in schedInfo)
+static int cmd_rate(const int* args){
+    long N = LOOP_TICKS_MS((long)args[1]);
+    scheduler_set_period(schedInfo, MAX_TASKS, args[0], (N > 0) ? (N < INT_MAX ? N : INT_MAX) : 1);
+    return 0;
+}
+
+// $PTEN,<task>,<enable>*: enable (1) or disable (0) a scheduler task
+static int cmd_task_enable(const int* args){
+    schedInfo[args[0]].enable = args[1];
+    return 0;
+}
+
+// $PPID,<loop>,<kp>,<ki>,<kd>*: gains of the surge (0) or yaw (1) PID in
+// hundredths of %/cm, %/(cm s) and % s/cm
+static int cmd_pid(const int* args){
+    Pid* p = args[0] ? &pid_yaw : &pid_surge;
+    pid_gains(p, PID_GAIN_Q8(args[1]), PID_GAIN_Q8(args[2]), PID_GAIN_Q8(args[3]), p->period_ms);
+    return 0;
+}
+
+// $PPIDR,<period_ms>*: period of both PIDs
+static int cmd_pid_rate(const int* args){
+    control_pid_rate(args[0]);
+    return 0;
+}
+
+// $PDTM,<ms>*: dead time of a wheel reversal
+static int cmd_dead_time(const int* args){
+    motor_set_dead_time(args[0]);
+    return 0;
+}
+
+// $PLAW,<law>*: 0 thresholds and proportional terms, 1 PID
+static int cmd_law(const int* args){
+    if (args[0] == LAW_PID && control_data.law != LAW_PID)
+        control_pid_reset();
+    control_data.law = args[0];
+    return 0;
+}
+
+// $PFLT,<channel>,<stage>,<kind>,<param>*: stage of the filters of the
+// battery (0) or IR (1) samples, param as filter_config takes it
+static int cmd_filter(const int* args){
+    return filter_config(&adc_filter[args[0]], args[1], args[2], args[3]) ? NACK_REJECTED : 0;
+}
+
+// $PTRC,<mode>*: 0 stops recording the trace, 1 starts a new recording,
+// 2 dumps the trace as TLM_REC_TRACE frames
+static int cmd_trace(const int* args){
+#if TRACE_ENABLE
+    if (args[0] == TRACE_RECORD)
+        trace_start(loop_ticks() + 1, 0);  // From the next iteration
+    else if (args[0] == TRACE_DUMP)
+        trace_dump();
+    else
+        trace_stop();
+    return 0;
+#else
+    return NACK_REJECTED;
+#endif
+}
+
+// $PPRF*: clear the timing statistics (min, max, histograms, overruns)
+static int cmd_perf_reset(const int* args){
+    perf_reset();
+    return 0;
+}
+
+static const command commands[] = {
+    { MSG_KEY4('P','C','T','H'),     2, {1, 1},  {150, 150},  cmd_thresholds },
+    { MSG_KEY4('P','S','T','T'),     1, {0},     {1},         cmd_state },
+    { MSG_KEY5('P','G','A','I','N'), 2, {0, 0},  {100, 2000}, cmd_gains },
+    { MSG_KEY4('P','T','L','M'),     1, {TELEMETRY_ASCII}, {TELEMETRY_BINARY}, cmd_telemetry },
+    { MSG_KEY5('P','R','A','T','E'), 2, {0, 1},  {MAX_TASKS - 1, 30000}, cmd_rate },
+    { MSG_KEY4('P','T','E','N'),     2, {0, 0},  {MAX_TASKS - 1, 1}, cmd_task_enable },
+    { MSG_KEY4('P','P','I','D'),     4, {0, 0, 0, 0}, {1, 10000, 5000, 1000}, cmd_pid },
+    { MSG_KEY5('P','P','I','D','R'), 1, {1},     {100},       cmd_pid_rate },
+    { MSG_KEY4('P','L','A','W'),     1, {LAW_PROPORTIONAL}, {LAW_PID}, cmd_law },
+    { MSG_KEY4('P','F','L','T'),     4, {ADC_BATTERY, 0, FILTER_NONE, 0}, {ADC_IR, FILTER_STAGES - 1, FILTER_EMA, 32767}, cmd_filter },
+    { MSG_KEY4('P','T','R','C'),     1, {TRACE_OFF}, {TRACE_DUMP}, cmd_trace },
+    { MSG_KEY4('P','D','T','M'),     1, {1},     {100},       cmd_dead_time },
+    { MSG_KEY4('P','P','R','F'),     0, {0},     {0},         cmd_perf_reset },
+};
+
+#define N_COMMANDS (sizeof(commands) / sizeof(commands[0]))
+
+// Open addressing index of the commands table, -1 for empty slots
+static signed char command_slot[COMMAND_SLOTS];
+
+static unsigned int command_hash(unsigned long key){
+    return (unsigned int)(key ^ (key >> 12) ^ (key >> 24)) & (COMMAND_SLOTS - 1);
+}
+
+void commands_init(void){
+    unsigned int k, h;
+
+    for (h = 0; h < COMMAND_SLOTS; h++)
+        command_slot[h] = -1;
+    for (k = 0; k < N_COMMANDS; k++) {
+        h = command_hash(commands[k].key);
+        while (command_slot[h] >= 0)
+            h = (h + 1) & (COMMAND_SLOTS - 1);
+        command_slot[h] = k;
+    }
+}
+
+static const command* command_find(unsigned long key){
+    unsigned int h = command_hash(key);
+
+    while (command_slot[h] >= 0) {
+        const command* c = &commands[(int)command_slot[h]];
+        if (c->key == key)
+            return c;
+        h = (h + 1) & (COMMAND_SLOTS - 1);
+    }
+    return NULL;
+}
+
+// Validate the arguments against the command schema and run its handler
+static int command_run(const command* c, const parser_state* ps){
+    int args[MSG_MAX_FIELDS];
+    int k;
+
+    if (ps->n_fields != c->n_args)
+        return NACK_ARGS;
+    for (k = 0; k < c->n_args; k++) {
+        if (!msg_field(ps, k, &args[k]))
+            return NACK_ARGS;
+        if (args[k] < c->min[k] || args[k] > c->max[k])
+            return NACK_RANGE;
+    }
+    return c->handler(args);
+}
+
+// Apply the message just parsed. Returns 0 if it was a command and it was
+// applied, the reason of the NACK otherwise. The command job calls it with
+// the control job masked, the handlers change what the control job uses
+int command_apply(const parser_state* ps){
+    const command* c = command_find(ps->type_key);
+    return (c != NULL) ? command_run(c, ps) : NACK_UNKNOWN;
+}
+
+// Acknowledge the message with the result of command_apply
+void command_ack(const parser_state* ps, int reason){
+#if COMMAND_ACK
+    Message m;
+    msg_begin(&m, reason ? "MNACK" : "MACK");
+    msg_str(&m, ps->msg_type);
+    if (reason)
+        msg_int(&m, reason);
+    if (msg_end(&m))
+        send_uart(m.data);    // Non-blocking, dropped if the queue is full
+#endif
+}
+
+// Execute the message just parsed. Returns 1 if it was a command and it was applied
+int command_dispatch(const parser_state* ps){
+    int reason = command_apply(ps);
+    command_ack(ps, reason);
+    return reason == 0;
+}
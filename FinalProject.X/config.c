@@ -0,0 +1,218 @@
+/*
+ * File:   config.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include "telemetry.h"
+#include <limits.h>
+#include <string.h>
+
+// Configuration kept in the data flash (hal_flash_*) as an emulated EEPROM:
+// each save appends a record to the active page; when that is full the other
+// page is erased and the record starts it, so a page is erased once every
+// CONFIG_SLOTS saves. Records carry a sequence number and a CRC: the newest
+// valid one is the configuration, and a save cut by a power loss leaves the
+// previous one in place.
+//
+// Record: uint8 CONFIG_MAGIC, uint8 CONFIG_VERSION, uint16 sequence, payload,
+// CRC-16 of all that, 0xFF up to a whole number of flash words. Payload,
+// little endian: int16 MINTH, MAXTH, surge_gain, yaw_scale, uint8 law,
+// telemetry mode, dead time in ms, task enables (bit k: task k), uint16 PID
+// period in ms, int32 Q8 kp, ki, kd of the surge then of the yaw PID, and
+// uint16 period in ms of each task. Records of another version are ignored:
+// bump CONFIG_VERSION when the payload changes (MAX_TASKS included)
+
+#define CONFIG_MAGIC   0xC5
+#define CONFIG_VERSION 1
+#define CONFIG_RX_QUIET_MS 2000  // Line quiet time before a save
+#define CONFIG_NEWER(a, b) ((a) != (b) && !(((a) - (b)) & 0x8000))  // 16 bit sequence numbers
+
+int config_loaded;                  // 1 if the boot configuration came from a record
+unsigned int config_seq;            // Sequence number of the newest record
+unsigned int config_saves;          // Records written since boot
+static int config_page;             // Page and slot of the newest record, slot -1 if none
+static int config_slot = -1;
+static unsigned char config_saved[CONFIG_PAYLOAD];  // Payload of the newest record, or the defaults
+
+static unsigned char* put16(unsigned char* p, unsigned int value){
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    return p + 2;
+}
+
+static unsigned char* put32(unsigned char* p, unsigned long value){
+    put16(p, value & 0xFFFF);
+    return put16(p + 2, value >> 16);
+}
+
+static unsigned int get16(const unsigned char* p){
+    return p[0] | (p[1] << 8);
+}
+
+static long get32(const unsigned char* p){
+    return (long)(get16(p) | ((unsigned long)get16(p + 2) << 16));
+}
+
+static unsigned char* put_pid(unsigned char* p, const Pid* pid){
+    p = put32(p, pid->kp);
+    p = put32(p, pid->ki);
+    return put32(p, pid->kd);
+}
+
+// Payload of the running configuration, read under the control job lock
+void config_capture(unsigned char* p){
+    int k, enables = 0, ipl = hal_ipl_raise(IPL_CONTROL);
+
+    p = put16(p, control_data.MINTH);
+    p = put16(p, control_data.MAXTH);
+    p = put16(p, control_data.surge_gain);
+    p = put16(p, control_data.yaw_scale);
+    *p++ = control_data.law;
+    *p++ = telemetry_mode;
+    *p++ = motor_dead_time();
+    for (k = 0; k < MAX_TASKS; k++)
+        enables |= (schedInfo[k].enable != 0) << k;
+    *p++ = enables;
+    p = put16(p, pid_surge.period_ms);
+    p = put_pid(p, &pid_surge);
+    p = put_pid(p, &pid_yaw);
+    for (k = 0; k < MAX_TASKS; k++)
+        p = put16(p, schedInfo[k].N * (long)LOOP_PERIOD_US / 1000);
+    hal_ipl_restore(ipl);
+}
+
+// Set the running configuration from a payload (at boot, before the jobs
+// start, or by the replay of a trace)
+void config_apply(const unsigned char* p){
+    int k, period_ms;
+    long N;
+
+    control_data.MINTH = get16(p);
+    control_data.MAXTH = get16(p + 2);
+    control_data.surge_gain = get16(p + 4);
+    control_data.yaw_scale = get16(p + 6);
+    control_data.law = p[8];
+    telemetry_mode = p[9];
+    motor_set_dead_time(p[10]);
+    for (k = 0; k < MAX_TASKS; k++)
+        schedInfo[k].enable = (p[11] >> k) & 1;
+    period_ms = get16(p + 12);
+    pid_gains(&pid_surge, get32(p + 14), get32(p + 18), get32(p + 22), period_ms);
+    pid_gains(&pid_yaw, get32(p + 26), get32(p + 30), get32(p + 34), period_ms);
+    control_pid_reset();
+    for (k = 0; k < MAX_TASKS; k++) {
+        N = LOOP_TICKS_MS((long)get16(p + 38 + 2 * k));
+        scheduler_set_period(schedInfo, MAX_TASKS, k, (N > 0) ? (N < INT_MAX ? N : INT_MAX) : 1);
+    }
+}
+
+static int config_crc_ok(const unsigned char* rec){
+    return tlm_crc16(rec, CONFIG_HEADER + CONFIG_PAYLOAD) == get16(rec + CONFIG_HEADER + CONFIG_PAYLOAD);
+}
+
+// Load the newest valid record over the defaults, if there is one. Reads the
+// headers of the HAL_FLASH_PAGES * CONFIG_SLOTS slots, then the candidates
+// from the newest until one passes the CRC: one record when the newest is
+// intact, all of them at worst. Called before Timer1 starts
+int config_load(void){
+    unsigned char rec[CONFIG_RECORD];
+    unsigned int seq[HAL_FLASH_PAGES * CONFIG_SLOTS];
+    unsigned char candidate[HAL_FLASH_PAGES * CONFIG_SLOTS];
+    int k, best;
+
+    for (k = 0; k < HAL_FLASH_PAGES * CONFIG_SLOTS; k++) {
+        hal_flash_read(k / CONFIG_SLOTS, (k % CONFIG_SLOTS) * CONFIG_RECORD, rec, CONFIG_HEADER);
+        candidate[k] = (rec[0] == CONFIG_MAGIC && rec[1] == CONFIG_VERSION);
+        seq[k] = get16(rec + 2);
+    }
+    config_loaded = 0;
+    config_page = 0;
+    config_slot = -1;
+    config_seq = 0;
+    do {
+        best = -1;
+        for (k = 0; k < HAL_FLASH_PAGES * CONFIG_SLOTS; k++)
+            if (candidate[k] && (best < 0 || CONFIG_NEWER(seq[k], seq[best])))
+                best = k;
+        if (best < 0)
+            break;
+        hal_flash_read(best / CONFIG_SLOTS, (best % CONFIG_SLOTS) * CONFIG_RECORD, rec, CONFIG_RECORD);
+        candidate[best] = 0;
+    } while (!config_crc_ok(rec));
+
+    if (best >= 0) {
+        config_apply(rec + CONFIG_HEADER);
+        config_page = best / CONFIG_SLOTS;
+        config_slot = best % CONFIG_SLOTS;
+        config_seq = seq[best];
+        config_loaded = 1;
+    }
+    config_capture(config_saved);
+    return config_loaded;
+}
+
+static int config_slot_erased(int page, int slot){
+    unsigned char rec[CONFIG_RECORD];
+    int k;
+
+    hal_flash_read(page, slot * CONFIG_RECORD, rec, CONFIG_RECORD);
+    for (k = 0; k < CONFIG_RECORD; k++)
+        if (rec[k] != 0xFF)
+            return 0;
+    return 1;
+}
+
+// Append the running configuration as a new record: in the first erased slot
+// after the newest record, else in the first slot of the other page, erased
+// first. The CPU stalls while the flash is written. Returns 0, or -1 if the
+// record does not read back
+int config_save(void){
+    unsigned char rec[CONFIG_RECORD], check[CONFIG_RECORD];
+    int k, page = config_page, slot = config_slot + 1;
+
+    config_capture(rec + CONFIG_HEADER);
+    rec[0] = CONFIG_MAGIC;
+    rec[1] = CONFIG_VERSION;
+    put16(rec + 2, (config_seq + 1) & 0xFFFF);
+    put16(rec + CONFIG_HEADER + CONFIG_PAYLOAD, tlm_crc16(rec, CONFIG_HEADER + CONFIG_PAYLOAD));
+    memset(rec + CONFIG_HEADER + CONFIG_PAYLOAD + 2, 0xFF, CONFIG_RECORD - CONFIG_HEADER - CONFIG_PAYLOAD - 2);
+
+    while (slot < CONFIG_SLOTS && !config_slot_erased(page, slot))
+        slot++;  // Skip the slots of cut saves
+    if (slot == CONFIG_SLOTS) {
+        page = (config_slot < 0) ? page : (page + 1) % HAL_FLASH_PAGES;
+        slot = 0;
+        if (hal_flash_erase(page))
+            return -1;
+    }
+    for (k = 0; k < CONFIG_RECORD; k += HAL_FLASH_WORD)
+        if (hal_flash_program(page, slot * CONFIG_RECORD + k, rec + k))
+            return -1;
+    hal_flash_read(page, slot * CONFIG_RECORD, check, CONFIG_RECORD);
+    if (memcmp(rec, check, CONFIG_RECORD) != 0)
+        return -1;
+
+    config_page = page;
+    config_slot = slot;
+    config_seq = (config_seq + 1) & 0xFFFF;
+    config_saves++;
+    memcpy(config_saved, rec + CONFIG_HEADER, CONFIG_PAYLOAD);
+    return 0;
+}
+
+// Save the configuration when it changed (commands), while the buggy waits
+// for start and nothing was received for CONFIG_RX_QUIET_MS. Writing the
+// flash stalls the CPU, interrupts included: a page erase (20 ms) overflows
+// the UART receive FIFO at 9600 baud, so the save waits for the operator to
+// stop sending commands
+void task_save_config(void* param){
+    unsigned char payload[CONFIG_PAYLOAD];
+
+    if (control_data.state != WaitForStart || rx_quiet_us() < CONFIG_RX_QUIET_MS * 1000UL)
+        return;
+    config_capture(payload);
+    if (memcmp(payload, config_saved, CONFIG_PAYLOAD) != 0)
+        config_save();
+}
@@ -0,0 +1,146 @@
+/*
+ * File:   control.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "header.h"
+
+// Integer control laws and motor mixing. The dsPIC has no FPU, so the whole
+// path from the measured distance to the OCxR compare values is kept in
+// integers: distances in 1/16 cm, surge and yaw rate in percent and wheel
+// commands in Q15.
+
+// Surge and yaw rate (percent) of the Moving state from the distance in 1/16 cm
+void control_law(volatile ControlData* data, int distance){
+    if (distance < data->MINTH * DIST_ONE) {
+        data->surge = 0;
+        data->yaw_rate = 100;
+    } else if (distance > data->MAXTH * DIST_ONE) {
+        data->surge = 100;
+        data->yaw_rate = 0;
+    } else {
+        // Proportional control: surge = surge_gain * d, yaw = yaw_scale / d
+        data->surge = ((long)distance * data->surge_gain) >> DIST_FRAC_BITS;
+        data->yaw_rate = (distance > 0) ? (long)data->yaw_scale * DIST_ONE / distance : 100;
+    }
+}
+
+// PID controllers of the Moving state (LAW_PID): the surge PID slows the buggy
+// down to stop at MINTH from the obstacle, the yaw PID turns it more and more
+// as the obstacle gets closer than MAXTH
+Pid pid_surge, pid_yaw;
+static int pid_ticks;     // Loop ticks since the last PID update
+
+void pid_init(Pid* p, int out_min, int out_max){
+    p->out_min = out_min;
+    p->out_max = out_max;
+    pid_gains(p, 0, 0, 0, PID_PERIOD_MS);
+    pid_reset(p);
+}
+
+// Set the Q8 gains and the period, the integral and derivative gains are
+// discretized for it
+void pid_gains(Pid* p, long kp, long ki, long kd, int period_ms){
+    p->kp = kp;
+    p->ki = ki;
+    p->kd = kd;
+    p->period_ms = period_ms;
+    p->ki_step = (ki << PID_I_BITS) * period_ms / 1000;
+    p->kd_step = kd * 1000 / period_ms;
+}
+
+void pid_reset(Pid* p){
+    p->integ = 0;
+    p->deriv = 0;
+    p->started = 0;
+}
+
+// One PID update, returns the output in percent. input is the measurement
+// signed so that error = setpoint - input: the derivative takes its change
+int pid_step(Pid* p, int error, int input){
+    long limit_lo = (long)p->out_min << PID_FRAC_BITS;
+    long limit_hi = (long)p->out_max << PID_FRAC_BITS;
+    long out;
+
+    // Derivative of -input, its change bounded so that kd_step * delta fits a long
+    if (p->started) {
+        int delta = p->prev_input - input;
+        if (delta > PID_MAX_DELTA)
+            delta = PID_MAX_DELTA;
+        else if (delta < -PID_MAX_DELTA)
+            delta = -PID_MAX_DELTA;
+        p->deriv += (p->kd_step * delta - p->deriv) >> PID_D_SHIFT;
+    }
+    p->prev_input = input;
+    p->started = 1;
+
+    // Anti-windup: the integral is clamped to the output range and stops
+    // integrating while the output saturates in the direction of the error
+    out = p->kp * error + (p->integ >> PID_I_BITS) + p->deriv;
+    if (!(out >= limit_hi && error > 0) && !(out <= limit_lo && error < 0)) {
+        p->integ += p->ki_step * error;
+        if (p->integ > limit_hi << PID_I_BITS)
+            p->integ = limit_hi << PID_I_BITS;
+        else if (p->integ < limit_lo << PID_I_BITS)
+            p->integ = limit_lo << PID_I_BITS;
+        out = p->kp * error + (p->integ >> PID_I_BITS) + p->deriv;
+    }
+    if (out > limit_hi)
+        out = limit_hi;
+    else if (out < limit_lo)
+        out = limit_lo;
+    return (out + (1L << (PID_FRAC_BITS - 1))) >> PID_FRAC_BITS;  // Rounded
+}
+
+// Default gains kp 6 %/cm, ki 0.2 %/(cm s), kd 0.4 % s/cm, tuned with
+// host/step_response for a short settling time with little overshoot
+void control_pid_init(void){
+    pid_init(&pid_surge, 0, 100);
+    pid_init(&pid_yaw, 0, 100);
+    pid_gains(&pid_surge, PID_GAIN_Q8(600), PID_GAIN_Q8(20), PID_GAIN_Q8(40), PID_PERIOD_MS);
+    pid_gains(&pid_yaw, PID_GAIN_Q8(600), PID_GAIN_Q8(20), PID_GAIN_Q8(40), PID_PERIOD_MS);
+    control_pid_reset();
+}
+
+// Restart both controllers, the next control_pid() call updates them
+void control_pid_reset(void){
+    pid_reset(&pid_surge);
+    pid_reset(&pid_yaw);
+    pid_ticks = pid_surge.period_ms * 1000L / LOOP_PERIOD_US;
+}
+
+void control_pid_rate(int period_ms){
+    pid_gains(&pid_surge, pid_surge.kp, pid_surge.ki, pid_surge.kd, period_ms);
+    pid_gains(&pid_yaw, pid_yaw.kp, pid_yaw.ki, pid_yaw.kd, period_ms);
+}
+
+// Called every loop tick, updates surge and yaw rate once per PID period and
+// holds them in between
+void control_pid(volatile ControlData* data, int distance){
+    if (++pid_ticks < pid_surge.period_ms * 1000L / LOOP_PERIOD_US)
+        return;
+    pid_ticks = 0;
+    data->surge = pid_step(&pid_surge, distance - data->MINTH * DIST_ONE, -distance);
+    data->yaw_rate = pid_step(&pid_yaw, data->MAXTH * DIST_ONE - distance, distance);
+}
+
+// Left and right wheel commands in Q15 from surge and yaw rate (percent).
+// When a wheel would exceed 100% both are scaled by the same factor, so the
+// ratio between the wheels (and the turning radius) is preserved.
+void mix_q15(int surge, int yaw_rate, int* left, int* right){
+    int l = surge + yaw_rate;
+    int r = surge - yaw_rate;
+    int al = (l < 0) ? -l : l;
+    int ar = (r < 0) ? -r : r;
+    int norm = (al > ar) ? al : ar;
+
+    if (norm < 100)
+        norm = 100;
+    *left = (long)l * Q15_ONE / norm;
+    *right = (long)r * Q15_ONE / norm;
+}
+
+// Compare value for a positive Q15 command on an OC module with the given period
+unsigned int q15_duty(int command, unsigned int period){
+    return ((unsigned long)command * period + (1U << 14)) >> 15;
+}
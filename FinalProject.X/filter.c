@@ -0,0 +1,166 @@
+/*
+ * File:   filter.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+
+// Filters of the ADC samples. The moving average is a MAC of the window with
+// 1/n and the EMA a MAC of the error with alpha, both run on the DSP engine
+// (accumulator A through the HAL_ACC macros, emulated on the host build).
+// The _ref versions compute the same results in portable C: they are used
+// when FILTER_DSP is 0 and the host benchmarks check the two against each other.
+
+#if FILTER_DSP
+#define filter_average filter_average_dsp
+#define filter_ema     filter_ema_dsp
+#else
+#define filter_average filter_average_ref
+#define filter_ema     filter_ema_ref
+#endif
+
+// Mean of the window, the weight is 1/n in Q15
+int filter_average_dsp(const int* window, int n, int coef){
+    HAL_ACC_DECLARE(acc);
+    int k;
+
+    HAL_ACC_CLR(acc);
+    for (k = 0; k < n; k++)
+        HAL_ACC_MAC(acc, window[k], coef);
+    return HAL_ACC_SACR(acc);
+}
+
+int filter_average_ref(const int* window, int n, int coef){
+    long sum = 0;
+    int k;
+
+    for (k = 0; k < n; k++)
+        sum += (long)window[k] * coef;
+    return (sum * 2 + 0x8000) >> 16;
+}
+
+// Next EMA state: state += alpha * (x - state), the state with FILTER_EMA_BITS
+// fraction bits. The error is taken on the high word of the state (the code
+// with FILTER_EMA_BITS - 16 fraction bits), the MAC adds alpha times it to the
+// whole state: steps below the high word accumulate in the low one, so the
+// state reaches x whatever alpha is
+long filter_ema_dsp(long state, int x, int alpha){
+    HAL_ACC_DECLARE(acc);
+
+    HAL_ACC_LAC32(acc, state);
+    HAL_ACC_MAC(acc, (x << (FILTER_EMA_BITS - 16)) - (int)(state >> 16), alpha);
+    return HAL_ACC_SAC32(acc);
+}
+
+long filter_ema_ref(long state, int x, int alpha){
+    int error = (x << (FILTER_EMA_BITS - 16)) - (int)(state >> 16);
+    return state + (long)error * alpha * 2;
+}
+
+// Median of the window (the upper one for an even n), by insertion sort of a copy
+int filter_median(const int* window, int n){
+    int sorted[FILTER_MAX_N];
+    int k, j;
+
+    for (k = 0; k < n; k++) {
+        int v = window[k];
+        for (j = k; j > 0 && sorted[j - 1] > v; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = v;
+    }
+    return sorted[n / 2];
+}
+
+// Same median over a sliding window: sorted holds the window in order, old
+// leaves it and x enters it, so a single pass of insertion replaces the sort
+int filter_median_slide(int* sorted, int n, int old, int x){
+    int k = 0;
+
+    while (sorted[k] != old)
+        k++;
+    // Shift towards the hole left by old until x fits
+    while (k > 0 && sorted[k - 1] > x) {
+        sorted[k] = sorted[k - 1];
+        k--;
+    }
+    while (k < n - 1 && sorted[k + 1] < x) {
+        sorted[k] = sorted[k + 1];
+        k++;
+    }
+    sorted[k] = x;
+    return sorted[n / 2];
+}
+
+void filter_init(FilterChain* c){
+    int k;
+    for (k = 0; k < FILTER_STAGES; k++)
+        filter_config(c, k, FILTER_NONE, 0);
+}
+
+// Set a stage of the chain: param is the window length (average, median) or
+// alpha in Q15 (EMA). Returns -1 if it is out of range. The stage restarts
+// from the next sample
+int filter_config(FilterChain* c, int stage, int kind, int param){
+    FilterStage* s = &c->stage[stage];
+
+    switch (kind) {
+        case FILTER_NONE:
+            param = 1;
+            break;
+        case FILTER_AVERAGE:
+        case FILTER_MEDIAN:
+            if (param < 1 || param > FILTER_MAX_N)
+                return -1;
+            break;
+        case FILTER_EMA:
+            if (param < 1 || param > 32767)
+                return -1;
+            break;
+        default:
+            return -1;
+    }
+    s->kind = kind;
+    s->n = (kind == FILTER_EMA) ? 1 : param;
+    if (kind == FILTER_EMA)
+        s->coef = param;
+    else
+        s->coef = (param == 1) ? 32767 : (32768 + param / 2) / param;
+    s->pos = 0;
+    s->primed = 0;
+    return 0;
+}
+
+static int stage_run(FilterStage* s, int x){
+    int k;
+
+    // The first sample fills the window, so the output starts from it
+    if (!s->primed) {
+        for (k = 0; k < s->n; k++)
+            s->window[k] = s->sorted[k] = x;
+        s->state = (long)x << FILTER_EMA_BITS;
+        s->primed = 1;
+    }
+    if (s->kind == FILTER_EMA) {
+        s->state = filter_ema(s->state, x, s->coef);
+        return (s->state + (1L << (FILTER_EMA_BITS - 1))) >> FILTER_EMA_BITS;
+    }
+
+    k = s->window[s->pos];
+    s->window[s->pos] = x;
+    if (++s->pos == s->n)
+        s->pos = 0;
+    if (s->kind == FILTER_AVERAGE)
+        return filter_average(s->window, s->n, s->coef);
+    return filter_median_slide(s->sorted, s->n, k, x);
+}
+
+// Run a sample through the stages of the chain, returns the filtered value
+int filter_push(FilterChain* c, int x){
+    int k;
+    for (k = 0; k < FILTER_STAGES; k++) {
+        if (c->stage[k].kind != FILTER_NONE)
+            x = stage_run(&c->stage[k], x);
+    }
+    return x;
+}
@@ -0,0 +1,110 @@
+/*
+ * File:   format.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "header.h"
+
+// Integer formatting of the $Mxxx telemetry messages. Replaces sprintf, which
+// drags the whole float printf into the image and costs thousands of cycles
+// per message. Every function is bounded by MSG_MAX_LEN: once a field does
+// not fit the message is marked as overflowed and msg_end() returns 0.
+
+// Append a single char, keeping room for the string terminator
+static void msg_putc(Message* m, char c){
+    if (m->len < 0)
+        return;
+    if (m->len >= MSG_MAX_LEN - 1) {
+        m->len = -1;
+        return;
+    }
+    m->data[m->len++] = c;
+}
+
+// Append the decimal digits of value, at least min_digits of them
+static void msg_putu(Message* m, unsigned int value, int min_digits){
+    char digits[10];  // Enough for the 32 bit int of the host build
+    int n = 0;
+
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (n < min_digits && n < (int)sizeof(digits))
+        digits[n++] = '0';
+    while (n > 0)
+        msg_putc(m, digits[--n]);
+}
+
+// Start a message: "$TYPE"
+void msg_begin(Message* m, const char* type){
+    m->len = 0;
+    msg_putc(m, '$');
+    while (*type != '\0')
+        msg_putc(m, *type++);
+}
+
+// Append ",<value>"
+void msg_int(Message* m, int value){
+    msg_putc(m, ',');
+    if (value < 0) {
+        msg_putc(m, '-');
+        msg_putu(m, -(unsigned int)value, 1);
+    } else {
+        msg_putu(m, value, 1);
+    }
+}
+
+// Append ",<value>" for values that may not fit an int
+void msg_ulong(Message* m, unsigned long value){
+    char digits[3 * sizeof(unsigned long)];  // 10 digits on the dsPIC, 20 on a 64 bit host
+    int n = 0;
+
+    msg_putc(m, ',');
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (n > 0)
+        msg_putc(m, digits[--n]);
+}
+
+// Append ",<text>"
+void msg_str(Message* m, const char* text){
+    msg_putc(m, ',');
+    while (*text != '\0')
+        msg_putc(m, *text++);
+}
+
+// Append ",<value / 10^decimals>" with exactly the given number of decimals,
+// e.g. msg_fixed(m, 1234, 2) appends ",12.34"
+void msg_fixed(Message* m, int value, int decimals){
+    unsigned int scale = 1, magnitude;
+    int d;
+
+    for (d = 0; d < decimals; d++)
+        scale *= 10;
+
+    msg_putc(m, ',');
+    if (value < 0) {
+        msg_putc(m, '-');
+        magnitude = -(unsigned int)value;
+    } else {
+        magnitude = value;
+    }
+    msg_putu(m, magnitude / scale, 1);
+    if (decimals > 0) {
+        msg_putc(m, '.');
+        msg_putu(m, magnitude % scale, decimals);
+    }
+}
+
+// Terminate the message with "*\n". Returns its length, or 0 if it overflowed
+int msg_end(Message* m){
+    msg_putc(m, '*');
+    msg_putc(m, '\n');
+    if (m->len < 0)
+        return 0;
+    m->data[m->len] = '\0';
+    return m->len;
+}
@@ -1,391 +1,511 @@
-/*
- * File:   functions.c
- * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
- */
-
-#include "xc.h"
-#include "header.h"
-#include <math.h>
-
-// Set up the timer with a specified period in milliseconds
-void tmr_setup_period(int timer, int ms){   
-    long steps = FCY * (ms / 1000.0); // Calculate number of clock cycles
-    int presc, t;                     
-    
-    // Find the smallest prescaler such that the number of required 
-    // steps fits within the MaxInt value of the timer
-    if (steps <= MaxInt) {           // Prescaler 1:1
-        presc = 1;
-        t = 0; // 00  
-    }
-    else if (steps/8 <= MaxInt) {    // Prescaler 1:8
-        presc = 8;
-        t = 1; // 01
-    }
-    else if (steps/64 <= MaxInt) {   // Prescaler 1:64
-        presc = 64;
-        t = 2; // 10
-    }
-    else if (steps/256 <= MaxInt) {  // Prescaler 1:256
-        presc = 256;
-        t = 3; // 11
-    }
-    else {
-        // Error: the desired period is too long even with the largest prescaler
-        return;
-    }
-   
-    // Configure the specified timer
-    switch(timer){
-        case TIMER1: 
-            TMR1 = 0;               // Reset timer counter
-            T1CONbits.TON = 0;      // Stops the timer
-            T1CONbits.TCKPS = t;    // Set the prescale value
-            PR1 = steps/presc;      // Set the number of clock step of the counter
-            T1CONbits.TON = 1;      // Starts the timer
-            break;
-            
-        case TIMER2: 
-            TMR2 = 0;              
-            T2CONbits.TON = 0;      
-            T2CONbits.TCKPS = t;   
-            PR2 = steps/presc;      
-            T2CONbits.TON = 1;      
-            break;
-    }
-}
-
-// Wait for a timer period to complete
-void tmr_wait_period(int timer){
-    switch(timer){
-        case TIMER1:
-            while(IFS0bits.T1IF == 0){};
-            IFS0bits.T1IF = 0; 
-            break;
-            
-        case TIMER2:
-            while(IFS0bits.T2IF == 0){};
-            IFS0bits.T2IF = 0; 
-            break;
-    }
-}
-
-// Set all buggy's lights as output
-void LigthsSetup(void){
-    TRISAbits.TRISA0 = 0; // Led1 (RA0) 
-    TRISBbits.TRISB8 = 0; // Left Side Lights (RB8)
-    TRISFbits.TRISF1 = 0; // Right Side Lights (RF1)
-    TRISAbits.TRISA7 = 0; // Beam Headlights (RA7)
-    TRISFbits.TRISF0 = 0; // Brakes (RF0)
-    TRISGbits.TRISG1 = 0; // Low Intensity Lights (RG1)
-}
-
-// Function to make LedA0 blink
-void task_blinkA0 (void* param){
-    LATAbits.LATA0 = !LATAbits.LATA0;
-}
-
-// Function to make Left and Right Indicators blink
-void task_blink_indicators (void* param) {
-    ControlData* data = (ControlData*)param;
-    
-    if (data->state == WaitForStart) {
-        LATFbits.LATF1 = !LATFbits.LATF1; // Right indicator blinking
-        LATBbits.LATB8 = !LATBbits.LATB8; // Left indicator blinking
-    }
-    else if (data->state == Moving) {
-        if (data->yaw_rate > 15)
-            LATFbits.LATF1 = !LATFbits.LATF1; // Right indicator blinking
-    }
-}
-
-// Function to setup the ADC
-void ADCsetup(void){
-    // IR Sensor analog configuration AN15 
-    TRISBbits.TRISB15 = 1;
-    ANSELBbits.ANSB15 = 1; 
-    TRISAbits.TRISA3 = 0; // IR sensor enable line  
-    LATAbits.LATA3 = 1;   // Enable pin
-    
-    // Enable Battery Sensor analog configuration AN11
-    TRISBbits.TRISB11 = 1;
-    ANSELBbits.ANSB11 = 1;
-    
-    AD1CON3bits.ADCS = 14;  // Select Tad
-    AD1CON1bits.ASAM = 0;   // Manual sampling
-    AD1CON1bits.SSRC = 7;   // Automatic conversion
-    AD1CON3bits.SAMC = 16;  // Sampling lasts 16 Tad 
-    AD1CON2bits.CHPS = 0;   // Use 1-channel (CH0) mode
-    AD1CON1bits.SIMSAM = 0; // Sequential sampling
-    
-    AD1CON2bits.CSCNA = 1;  // Scan mode enabled
-    AD1CSSLbits.CSS15 = 1;  // Scan for AN15 IR sensor
-    AD1CSSLbits.CSS11 = 1;  // Scan for AN11 Battery sensor
-    AD1CON2bits.SMPI = 1;   // N-1 channels
-    
-    AD1CON1bits.ADON = 1;   // Turn on the ADC module
-}
-
-// Function to setup the UART (mounted on mikroBUS2, 9600 bps)
-void UARTsetup(void){
-    // From documentation (pag.9 datasheet):
-    // RD0(RP64) -> TX
-    // RD11(RPI75) -> RX
-    // For Transitter: Find 'OUTPUT SELECTION FOR REMAPPABLE PINS' in datasheet
-    // Under U2TX -> 000011 -> 0x03 in hex
-    // For Receiver: Find 'INPUT PIN SELECTION FOR SELECTABLE INPUT SOURCES' in datasheet
-    // Under RPI75 -> 1001011 -> 0x4B
-    
-    RPOR0bits.RP64R = 0x03;   //Map UART2 TX to pin RD0 which is RP64
-    RPINR19bits.U2RXR = 0x4B; //Map UART2 RX to pin RD11 which is RPI75
-    
-    U2BRG = FCY / (16L * 9600) - 1;
-    U2MODEbits.UARTEN = 1;    // Enable UART 
-    U2STAbits.UTXEN = 1;      // Enable Transmission (must be after UARTEN)
-}
-
-// Function to set the PWM with Output Compare module
-void PWMsetup(int PWM_freq){
-    
-    //OC1 010000 RPn tied to Output Compare 1 Output
-    //OC2 010001 RPn tied to Output Compare 2 Output
-    //OC3 010010 RPn tied to Output Compare 3 Output
-    //OC4 010011 RPn tied to Output Compare 4 Output
-    
-    RPOR0bits.RP65R = 0x10; // RD1 is RP65 (OC1: 010000 -> 0x10 in hex)
-    RPOR1bits.RP66R = 0x11; // RD2 is RP66 (OC2: 010001 -> 0x11 in hex)
-    RPOR1bits.RP67R = 0x12; // RD3 is RP67 (OC3: 010010 -> 0x12 in hex)
-    RPOR2bits.RP68R = 0x13; // RD4 is RP68 (OC4: 010011 -> 0x13 in hex)
-    
-    // OC1: left wheels anticlockwise
-    OC1CON1bits.OCTSEL = 7;     // Selects the peripheral clock (111 = 7) as the clock source to the OC module
-    OC1CON1bits.OCM = 6;        // Configures the OC module in Edge-Aligned PWM mode (110 = 6)
-    OC1CON2bits.SYNCSEL = 0x1F; // Specifies that the OC module is synchronized to itself, meaning it operates independently without external synchronization: Tpwm = Tcy (11111 = 1f)
-    
-    // OC2: left wheels clockwise
-    OC2CON1bits.OCTSEL = 7;
-    OC2CON1bits.OCM = 6; 
-    OC2CON2bits.SYNCSEL = 0x1F;
-
-    // OC3: right wheels anticlockwise
-    OC3CON1bits.OCTSEL = 7;
-    OC3CON1bits.OCM = 6;
-    OC3CON2bits.SYNCSEL = 0x1F;
-
-    // OC4: right wheels clockwise
-    OC4CON1bits.OCTSEL = 7;
-    OC4CON1bits.OCM = 6;
-    OC4CON2bits.SYNCSEL = 0x1F;
-    
-    // OCxRS define the max period
-    OC1RS = OC2RS = OC3RS = OC4RS = FCY/PWM_freq; // 100% of TCY/OC_Freq 
-    
-    // Setup OCxR to 0 at start
-    OC1R = OC2R = OC3R = OC4R = 0;
-}
-
-// Function to stop PWM
-void PWMstop(void){
-    OC1R = OC2R = OC3R = OC4R = 0;
-}
-
-// Function to start PWM and control motor direction
-void PWMstart(ControlData* data){  
-    // Calculate left and right PWM values
-    float left_pwm = data->surge + data->yaw_rate;
-    float right_pwm = data->surge - data->yaw_rate;
-    
-    // Normalize PWM values to ensure they are within the range -100% to 100%
-    float max_pwm = fmax(fabs(left_pwm), fabs(right_pwm));
-    if (max_pwm > 100) {
-        left_pwm *= 0.9;
-        right_pwm *= 0.9;
-    }
-    
-    // Generate PWM signals for the wheels
-    if (left_pwm > 0) {
-        OC1R = 0; 
-        OC2R = left_pwm/100 * OC2RS; 
-    } 
-    else {
-        OC1R = (-left_pwm/100) * OC1RS; 
-        OC2R = 0; 
-    }
-    
-    if (right_pwm > 0) {
-        OC3R = 0; 
-        OC4R = right_pwm/100 * OC4RS;
-    } 
-    else {
-        OC3R = (-right_pwm/100) * OC3RS;
-        OC4R = 0; 
-    }
-}
-
-// Read IR or Battery sensor tension
-float getMeasurements(int flag){
-    float ADCValue, V;
-    if(flag){
-        ADCValue = ADC1BUF1;        // Get ADC value 
-        V = ADCValue * 3.3/1024.0;  // Convert to voltage
-        float distance = 100 * (2.34 - 4.74 * V + 4.06 * powf(V,2) - 1.60 * powf(V,3) + 0.24 * powf(V,4));
-        return distance;
-    }
-    else{
-        ADCValue = ADC1BUF0;
-        V = ADCValue * 3.3/1024.0;
-        const float R49 = 100.0, R51 = 100.0, R54 = 100.0;
-        float Rs = R49 + R51;
-        float battery = V * (Rs + R54) / R54;
-        return battery;
-    }
-   
-}
-
-void scheduler(heartbeat schedInfo[], int nTasks){
-    int i;
-    for (i = 0; i < nTasks; i++) {
-        schedInfo[i].n++;
-        if (schedInfo[i].enable == 1 && schedInfo[i].n >= schedInfo[i].N) {
-            schedInfo[i].f(schedInfo[i].params);            
-            schedInfo[i].n = 0;
-        }
-    }
-}
-
-void task_send_distance(void* param){
-    float distance = getMeasurements(DISTANCE);
-    
-    char buffer[16];
-    sprintf(buffer, "MDIST,%d*\n", (int)distance); 
-    send_uart(buffer);
-}
-
-void task_send_battery(void* param){
-    float battery = getMeasurements(BATTERY);
-    
-    char buffer[16];
-    sprintf(buffer, "$MBATT,%.2f*\n", battery);
-    send_uart(buffer);
-}
-
-void task_send_dutycycle(void* param){
-    // OCxR - Sets the time the signal is high
-    // OCxRS - Sets the period of the PWM signal
-    int dc1 = (int)(((float)OC1R / (float)OC1RS) * 100);
-    int dc2 = (int)(((float)OC2R / (float)OC2RS) * 100);
-    int dc3 = (int)(((float)OC3R / (float)OC3RS) * 100);
-    int dc4 = (int)(((float)OC4R / (float)OC4RS) * 100);
-    
-    char buffer[16];
-    sprintf(buffer, "$MPWM,%d,%d,%d,%d*\n", dc1, dc2, dc3, dc4);
-    send_uart(buffer);
-}
-
-// Utility function to send data over UART
-void send_uart(char* data) {
-    for (int i = 0; i < strlen(data); i++){
-        while (U2STAbits.UTXBF == 1); // Wait until the Transmit Buffer is not full
-        U2TXREG = data[i];
-    }
-}
-
-// Requires a pointer to a parser state, and the byte to process. returns NEW_MESSAGE if a message has been successfully parsed.
-// The result can be found in msg_type and msg_payload. Parsing another byte will override the contents of those arrays.
-int parse_byte(parser_state* ps, char byte) {
-    switch (ps->state) {
-        case STATE_DOLLAR:
-            if (byte == '$') {
-                ps->state = STATE_TYPE;
-                ps->index_type = 0;
-            }
-            break;
-        case STATE_TYPE:
-            if (byte == ',') {
-                ps->state = STATE_PAYLOAD;
-                ps->msg_type[ps->index_type] = '\0';
-                ps->index_payload = 0; // initialize properly the index
-            } else if (ps->index_type == 6) { // error! 
-                ps->state = STATE_DOLLAR;
-                ps->index_type = 0;
-			} else if (byte == '*') {
-				ps->state = STATE_DOLLAR; // get ready for a new message
-                ps->msg_type[ps->index_type] = '\0';
-				ps->msg_payload[0] = '\0'; // no payload
-                return NEW_MESSAGE;
-            } else {
-                ps->msg_type[ps->index_type] = byte; // ok!
-                ps->index_type++; // increment for the next time;
-            }
-            break;
-        case STATE_PAYLOAD:
-            if (byte == '*') {
-                ps->state = STATE_DOLLAR; // get ready for a new message
-                ps->msg_payload[ps->index_payload] = '\0';
-                return NEW_MESSAGE;
-            } else if (ps->index_payload == 100) { // error
-                ps->state = STATE_DOLLAR;
-                ps->index_payload = 0;
-            } else {
-                ps->msg_payload[ps->index_payload] = byte; // ok!
-                ps->index_payload++; // increment for the next time;
-            }
-            break;
-    }
-    return NO_MESSAGE;
-}
-
-// Takes a string as input, and converts it to an integer. Stops parsing when reaching
-// the end of string or a "," the result is undefined if a wrong string is passed
-int extract_integer(const char* str) {
-	int i = 0, number = 0, sign = 1;
-	
-	if (str[i] == '-') {
-		sign = -1;
-		i++;
-	}
-	else if (str[i] == '+') {
-		sign = 1;
-		i++;
-	}
-	while (str[i] != ',' && str[i] != '\0') {
-		number *= 10; // multiply the current number by 10;
-		number += str[i] - '0'; // converting character to decimal number
-		i++;
-	}
-	return sign*number;
-}		
-
-// The function takes a string, and an index within the string, and returns the index where the next data can be found
-// Example: with the string "10,20,30", and i=0 it will return 3. With the same string and i=3, it will return 6.
-int next_value(const char* msg, int i) {
-	while (msg[i] != ',' && msg[i] != '\0') { i++; }
-	if (msg[i] == ',')
-		i++;
-	return i;
-}
-
-// Function to push data into the circular buffer
-void cb_push(volatile CircularBuffer *cb, char data) {
-    
-    cb->buffer[cb->head] = data;  // Load the data into the buffer at the current head position
-    cb->head++;                   // Move the head to the next data offset
-    cb->to_read++;                // Increment the variable keeping track of the char available for reading
-    
-    // Wrap around to the beginning if we've reached the end of the buffer
-    if (cb->head == BUFFER_SIZE)
-        cb->head = 0;             
-}
-
-// Function to pop data from the circular buffer
-int cb_pop(volatile CircularBuffer *cb, char *data) {
-    if (cb->to_read == 0)           // If there are no chars that can be read
-        return 0;                   // Return 0 to indicate a failed pop 
-    
-    *data = cb->buffer[cb->tail];   // Read the data from the buffer at the current tail position
-    cb->tail = (cb->tail + 1) % BUFFER_SIZE; // Wrap around to the beginning if we've reached the end of the buffer
-    cb->to_read--;
-    
-    return 1;                       // Return 1 to indicate a successful pop
-}
-
+/*
+ * File:   functions.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include "telemetry.h"
+#include <string.h>
+#include <limits.h>
+
+// Set up a timer with a period in microseconds (TMR_SETUP_US at run time).
+// Returns TMR_OK, or the reason the timer was left untouched
+int tmr_setup_us(int timer, unsigned long us){
+    int error = TMR_ERROR(timer, us);
+    
+    if (error != TMR_OK)
+        return error;
+    hal_timer_config(timer, TMR_TCKPS(timer, us), TMR_PR(timer, us));
+    return TMR_OK;
+}
+
+// Function to make LedA0 blink
+void task_blinkA0 (void* param){
+    hal_gpio_toggle(LED_A0);
+}
+
+// Function to make Left and Right Indicators blink
+void task_blink_indicators (void* param) {
+    ControlData* data = (ControlData*)param;
+    
+    if (data->state == WaitForStart) {
+        hal_gpio_toggle(RIGHT); // Right indicator blinking
+        hal_gpio_toggle(LEFT);  // Left indicator blinking
+    }
+    else if (data->state == Moving) {
+        if (data->yaw_rate > 15)
+            hal_gpio_toggle(RIGHT); // Right indicator blinking
+    }
+}
+
+// Function to setup the ADC (AN15 IR sensor and AN11 battery sensor, free running)
+// and the filters of the two channels: median of 5 and mean of 8 against the
+// spikes and the noise of the IR sensor, a slow EMA for the battery
+void ADCsetup(void){
+    filter_init(&adc_filter[ADC_IR]);
+    filter_config(&adc_filter[ADC_IR], 0, FILTER_MEDIAN, 5);
+    filter_config(&adc_filter[ADC_IR], 1, FILTER_AVERAGE, 8);
+    filter_init(&adc_filter[ADC_BATTERY]);
+    filter_config(&adc_filter[ADC_BATTERY], 0, FILTER_EMA, 64);
+    hal_adc_init();
+}
+
+// Function to setup the UART (mounted on mikroBUS2, 9600 bps)
+void UARTsetup(void){
+    hal_uart_init(9600);
+}
+
+volatile AdcRing adcr;
+FilterChain adc_filter[2];          // Indexed by ADC_BATTERY and ADC_IR
+static unsigned int adc_tail;       // Next sample of adcr to filter
+static AdcSample adc_out;           // Last filtered sample
+
+// ADC interrupt: publish a new pair of codes
+void isr_adc(unsigned int battery, unsigned int ir){
+    unsigned int i = adcr.head & (ADC_RING - 1);
+    adcr.sample[i].battery = battery;
+    adcr.sample[i].ir = ir;
+    adcr.head++;
+}
+
+// Copy the last complete ADC sample without masking interrupts; the copy is
+// retried if a new sample was published meanwhile. Returns its sequence number
+unsigned int adc_latest(AdcSample* out){
+    unsigned int head;
+    do {
+        head = adcr.head;
+        *out = adcr.sample[(head - 1) & (ADC_RING - 1)];
+    } while (head != adcr.head);
+    return head;
+}
+
+// Run the samples published since the last call through the filters of their
+// channel and return the filtered sample. The samples are copied out of the
+// ring first, without masking interrupts; the ones the interrupt may have
+// overwritten meanwhile are dropped. Returns the number of samples filtered
+int adc_filtered(AdcSample* out){
+    AdcSample s[ADC_RING];
+    unsigned int head = adcr.head, now, first, k;
+
+    if (head - adc_tail > ADC_RING - 1) {
+        adcr.lost += head - adc_tail - (ADC_RING - 1);
+        adc_tail = head - (ADC_RING - 1);
+    }
+    for (k = adc_tail; k != head; k++)
+        s[k & (ADC_RING - 1)] = adcr.sample[k & (ADC_RING - 1)];
+
+    // Slot k is rewritten by the interrupt publishing k + ADC_RING
+    now = adcr.head;
+    first = adc_tail;
+    if (now - first > ADC_RING - 1) {
+        adcr.lost += now - first - (ADC_RING - 1);
+        first = now - (ADC_RING - 1);
+    }
+    for (k = first; k != head; k++) {
+        adc_out.battery = filter_push(&adc_filter[ADC_BATTERY], s[k & (ADC_RING - 1)].battery);
+        adc_out.ir = filter_push(&adc_filter[ADC_IR], s[k & (ADC_RING - 1)].ir);
+    }
+    adc_tail = head;
+    *out = adc_out;
+    return head - first;
+}
+
+// Interpolate a conversion table at a raw 10 bit ADC code
+int adc_lookup(const int* table, unsigned int code){
+    unsigned int i = code >> ADC_LUT_SHIFT;
+    int a = table[i];
+#if ADC_LUT_SHIFT > 0
+    int frac = code & ((1 << ADC_LUT_SHIFT) - 1);
+    a += ((long)(table[i + 1] - a) * frac) >> ADC_LUT_SHIFT;
+#endif
+    return a;
+}
+
+// Read IR distance (1/16 cm) or Battery tension (centivolts) from the latest sample
+int getMeasurements(int flag){
+    AdcSample s;
+    adc_latest(&s);
+    if(flag)
+        return adc_lookup(adc_distance_lut, s.ir);
+    else
+        return adc_lookup(adc_battery_lut, s.battery);
+}
+
+// Task indexes sorted by next release, so that a tick only looks at the tasks
+// that are due. There is a single scheduler, the one of the control loop.
+static unsigned char sched_order[SCHED_MAX_TASKS];
+static unsigned long sched_tick;  // Tick of the next scheduler() call
+static volatile unsigned int sched_released, sched_started;  // All the tasks
+
+// Move the task at position k of sched_order to its place by next release
+static void sched_sort(heartbeat schedInfo[], int nTasks, int k){
+    unsigned char task = sched_order[k];
+    
+    while (k + 1 < nTasks && (long)(schedInfo[sched_order[k + 1]].next - schedInfo[task].next) <= 0) {
+        sched_order[k] = sched_order[k + 1];
+        k++;
+    }
+    while (k > 0 && (long)(schedInfo[sched_order[k - 1]].next - schedInfo[task].next) > 0) {
+        sched_order[k] = sched_order[k - 1];
+        k--;
+    }
+    sched_order[k] = task;
+}
+
+// nTasks must not exceed SCHED_MAX_TASKS
+void scheduler_init(heartbeat schedInfo[], int nTasks){
+    int i;
+    sched_tick = 0;
+    sched_released = sched_started = 0;
+    for (i = 0; i < nTasks; i++) {
+        schedInfo[i].next = schedInfo[i].phase;
+        schedInfo[i].runs = 0;
+        schedInfo[i].released = schedInfo[i].started = 0;
+        schedInfo[i].late_min_us = UINT_MAX;
+        schedInfo[i].late_max_us = 0;
+        sched_order[i] = i;
+        sched_sort(schedInfo, i + 1, i);  // Insert among the tasks sorted so far
+    }
+}
+
+// Change the period of a task. The next release is moved to the last release
+// plus the new period; if that is already past the task runs on the next tick.
+// Before the first tick (a configuration loaded at boot) the phase is kept
+void scheduler_set_period(heartbeat schedInfo[], int nTasks, int task, int N){
+    int k;
+    heartbeat* t = &schedInfo[task];
+    
+    t->next = t->next - t->N + N;
+    t->N = N;
+    if ((long)(t->next - sched_tick) < 0)
+        t->next = sched_tick;
+    for (k = 0; sched_order[k] != task; k++)
+        ;
+    sched_sort(schedInfo, nTasks, k);
+}
+
+// Release the tasks due at or before tick, tick being the number of control
+// loop iterations since scheduler_init. Called by the control job
+void scheduler(heartbeat schedInfo[], int nTasks, unsigned long tick){
+    sched_tick = tick + 1;
+    while ((long)(tick - schedInfo[sched_order[0]].next) >= 0) {
+        heartbeat* t = &schedInfo[sched_order[0]];
+        
+        if (t->enable == 1) {
+            t->released_at = t->next;
+            t->released++;
+            sched_released++;
+        }
+        
+        // Next release, skipping the ones already missed
+        do {
+            t->next += t->N;
+        } while ((long)(tick - t->next) >= 0);
+        sched_sort(schedInfo, nTasks, 0);
+    }
+}
+
+// Released tasks not run yet
+int scheduler_pending(void){
+    return sched_started != sched_released;
+}
+
+// Run the released tasks in task order, from the background loop. A task
+// released again before it could run runs once
+void scheduler_run(heartbeat schedInfo[], int nTasks){
+    int i;
+    
+    if (sched_started == sched_released)
+        return;
+    sched_started = sched_released;
+    for (i = 0; i < nTasks; i++) {
+        heartbeat* t = &schedInfo[i];
+        int ipl;
+        unsigned long release;
+        
+        if (t->started == t->released)
+            continue;
+        ipl = hal_ipl_raise(IPL_CONTROL);
+        t->started = t->released;
+        release = t->released_at;
+        hal_ipl_restore(ipl);
+        
+        unsigned int late = loop_time_us() - release * LOOP_PERIOD_US;
+        t->runs++;
+        if (late < t->late_min_us)
+            t->late_min_us = late;
+        if (late > t->late_max_us)
+            t->late_max_us = late;
+        t->f(t->params);
+    }
+}
+
+int telemetry_mode = TELEMETRY_ASCII;
+
+// Queue a binary telemetry record as one frame
+static int send_record(const unsigned char* record, int len){
+    unsigned char frame[TLM_MAX_FRAME];
+    int n = tlm_frame(record, len, frame);
+    return n ? send_uart_bytes((const char*)frame, n) : 0;
+}
+
+// Telemetry snapshot: what the last control loop iteration read and wrote,
+// sent as a single message ($MTLM or a TLM_REC_SNAPSHOT frame). The task runs
+// in the background after the control job, which may preempt it: the values
+// are copied with the job masked, so surge, yaw rate and OCxR are the ones
+// computed from the snapshot inputs.
+void task_send_telemetry(void* param){
+    // Copied with the control job masked, so that all the values come from the same iteration
+    int ipl = hal_ipl_raise(IPL_CONTROL);
+    LoopSnapshot snapshot = loop_snapshot;
+    int surge = control_data.surge;
+    int yaw_rate = control_data.yaw_rate;
+    // OCxR - Sets the time the signal is high
+    // OCxRS - Sets the period of the PWM signal
+    unsigned int oc[4] = {HAL_OC1R, HAL_OC2R, HAL_OC3R, HAL_OC4R};
+    unsigned int period[4] = {HAL_OC1RS, HAL_OC2RS, HAL_OC3RS, HAL_OC4RS};
+    hal_ipl_restore(ipl);
+    
+    const LoopSnapshot* s = &snapshot;
+    int moving = (s->state == Moving);
+    unsigned int battery = adc_lookup(adc_battery_lut, s->sample.battery);  // Centivolts
+    unsigned char duty[4];
+    for (int k = 0; k < 4; k++)
+        duty[k] = 100L * oc[k] / period[k];
+    if (!moving)
+        surge = yaw_rate = 0;
+    
+    if (telemetry_mode == TELEMETRY_BINARY) {
+        unsigned char rec[TLM_MAX_RECORD];
+        send_record(rec, tlm_record_snapshot(rec, s->distance, battery, surge, yaw_rate, duty, s->state));
+        return;
+    }
+    Message m;
+    msg_begin(&m, "MTLM");
+    msg_fixed(&m, ((long)s->distance * 100) >> DIST_FRAC_BITS, 2);  // cm
+    msg_fixed(&m, battery, 2);                                      // V
+    msg_int(&m, surge);
+    msg_int(&m, yaw_rate);
+    for (int k = 0; k < 4; k++)
+        msg_int(&m, duty[k]);
+    msg_int(&m, s->state);
+    if (msg_end(&m))
+        send_uart(m.data);
+}
+
+volatile TxQueue txq;
+
+// Queue a message for transmission over UART without waiting. The message is
+// queued entirely or not at all: returns 1 on success, 0 if it was dropped
+int send_uart(const char* data) {
+    return send_uart_bytes(data, strlen(data));
+}
+
+// Same as send_uart for data that may contain '\0' (binary telemetry frames).
+// The command job and the background loop both send: the command job is
+// masked while a message is queued, so that messages are not interleaved
+int send_uart_bytes(const char* data, unsigned int len) {
+    int ipl = hal_ipl_raise(IPL_COMMANDS);
+    unsigned int head = txq.head;
+    unsigned int used = head - txq.tail;
+    
+    if (len > TX_BUFFER_SIZE - used) {
+        txq.dropped++;
+        hal_ipl_restore(ipl);
+        return 0;
+    }
+    
+    for (unsigned int i = 0; i < len; i++)
+        txq.buffer[(head + i) & (TX_BUFFER_SIZE - 1)] = data[i];
+    txq.head = head + len;  // Publish the message to the interrupt
+    
+    if (used + len > txq.high_water)
+        txq.high_water = used + len;
+    hal_ipl_restore(ipl);
+    
+    hal_uart_tx_irq(1);     // Make sure the interrupt is draining the queue
+    return 1;
+}
+
+// U2TX interrupt: move queued bytes into the hardware FIFO until it is full
+void isr_uart_tx(void) {
+    unsigned int tail = txq.tail;
+    
+    while (tail != txq.head && hal_uart_tx_full() == 0) {
+        hal_uart_write(txq.buffer[tail & (TX_BUFFER_SIZE - 1)]);
+        tail++;
+    }
+    txq.tail = tail;
+    
+    if (tail == txq.head)
+        hal_uart_tx_irq(0); // Nothing left, send_uart re-enables it
+}
+
+void parser_init(parser_state* ps) {
+    ps->state = STATE_DOLLAR;
+    ps->index_type = 0;
+    ps->index_payload = 0;
+    ps->n_fields = 0;
+}
+
+// Start a new payload field
+static void field_begin(parser_state* ps) {
+    ps->magnitude = 0;
+    ps->digits = 0;
+    ps->sign = 0;
+}
+
+// Store the field being parsed, if there is room for it
+static void field_end(parser_state* ps) {
+    int k = ps->n_fields++;
+    
+    if (k >= MSG_MAX_FIELDS)
+        return;
+    if (ps->digits > 0) {
+        // Written so that INT_MIN does not overflow
+        ps->fields[k] = (ps->sign < 0) ? -(int)(ps->magnitude - 1) - 1 : (int)ps->magnitude;
+        ps->field_valid |= 1U << k;
+    } else {
+        ps->fields[k] = 0;
+    }
+}
+
+// Add a payload char to the field being parsed: an optional sign followed by
+// decimal digits, anything else or a value out of the int range marks it malformed
+static void field_putc(parser_state* ps, char byte) {
+    if (ps->digits < 0)
+        return;
+    if (byte >= '0' && byte <= '9') {
+        unsigned int limit = (ps->sign < 0) ? (unsigned int)INT_MAX + 1 : INT_MAX;
+        unsigned int digit = byte - '0';
+        if (ps->magnitude > (limit - digit) / 10) {
+            ps->digits = -1;
+        } else {
+            ps->magnitude = ps->magnitude * 10 + digit;
+            ps->digits++;
+        }
+    } else if ((byte == '-' || byte == '+') && ps->digits == 0 && ps->sign == 0) {
+        ps->sign = (byte == '-') ? -1 : 1;
+    } else {
+        ps->digits = -1;
+    }
+}
+
+// Requires a pointer to a parser state, and the byte to process. returns NEW_MESSAGE if a message has been successfully parsed.
+// The result can be found in msg_type and, for the payload, with msg_field(). Parsing another byte will override them.
+int parse_byte(parser_state* ps, char byte) {
+    switch (ps->state) {
+        case STATE_DOLLAR:
+            if (byte == '$') {
+                ps->state = STATE_TYPE;
+                ps->index_type = 0;
+                ps->type_key = 0;
+            }
+            break;
+        case STATE_TYPE:
+            if (byte == ',') {
+                ps->state = STATE_PAYLOAD;
+                ps->msg_type[ps->index_type] = '\0';
+                ps->index_payload = 0; // initialize properly the index
+                ps->n_fields = 0;
+                ps->field_valid = 0;
+                field_begin(ps);
+            } else if (byte == '*') {
+                ps->state = STATE_DOLLAR; // get ready for a new message
+                ps->msg_type[ps->index_type] = '\0';
+                ps->n_fields = 0;         // no payload
+                ps->field_valid = 0;
+                return NEW_MESSAGE;
+            } else if (ps->index_type == 5) { // error! no room for the terminator
+                ps->state = STATE_DOLLAR;
+                ps->index_type = 0;
+            } else {
+                ps->msg_type[ps->index_type] = byte; // ok!
+                ps->index_type++; // increment for the next time;
+                if (byte >= ' ' && byte <= '^' && ps->type_key != MSG_KEY_INVALID)
+                    ps->type_key = ps->type_key << 6 | MSG_KEY_CHAR(byte);
+                else
+                    ps->type_key = MSG_KEY_INVALID;  // Matches no command
+            }
+            break;
+        case STATE_PAYLOAD:
+            if (byte == '*') {
+                field_end(ps);
+                ps->state = STATE_DOLLAR; // get ready for a new message
+                return NEW_MESSAGE;
+            } else if (ps->index_payload == MSG_MAX_PAYLOAD) { // error
+                ps->state = STATE_DOLLAR;
+                ps->index_payload = 0;
+            } else if (byte == ',') {
+                field_end(ps);
+                field_begin(ps);
+                ps->index_payload++;
+            } else {
+                field_putc(ps, byte);
+                ps->index_payload++; // increment for the next time;
+            }
+            break;
+    }
+    return NO_MESSAGE;
+}
+
+// Value of the k-th payload field of the last message parsed.
+// Returns 1 if the field exists and is a valid integer, 0 otherwise
+int msg_field(const parser_state* ps, int k, int* value) {
+    if (k < 0 || k >= MSG_MAX_FIELDS || k >= ps->n_fields || !(ps->field_valid & (1U << k)))
+        return 0;
+    *value = ps->fields[k];
+    return 1;
+}
+
+// Function to push data into the circular buffer (producer side).
+// Returns 1 on success, 0 if the buffer was full and the byte was dropped
+int cb_push(volatile CircularBuffer *cb, char data) {
+    unsigned int head = cb->head;
+    unsigned int used = head - cb->tail;
+    
+    if (used == BUFFER_SIZE) {      // Never overwrite unread data
+        cb->dropped++;
+        return 0;
+    }
+    
+    cb->buffer[head & (BUFFER_SIZE - 1)] = data;  // Load the data at the current head position
+    cb->head = head + 1;            // Publish it to the consumer
+    
+    if (used + 1 > cb->high_water)
+        cb->high_water = used + 1;
+    return 1;
+}
+
+// Function to pop data from the circular buffer (consumer side)
+int cb_pop(volatile CircularBuffer *cb, char *data) {
+    unsigned int tail = cb->tail;
+    if (tail == cb->head)           // If there are no chars that can be read
+        return 0;                   // Return 0 to indicate a failed pop 
+    
+    *data = cb->buffer[tail & (BUFFER_SIZE - 1)]; // Read the data at the current tail position
+    cb->tail = tail + 1;            // Release the slot to the producer
+    
+    return 1;                       // Return 1 to indicate a successful pop
+}
+
+// Pop up to max chars at once, returns how many were copied
+int cb_pop_bulk(volatile CircularBuffer *cb, char *data, int max) {
+    unsigned int tail = cb->tail;
+    unsigned int available = cb->head - tail;
+    int n;
+    
+    if (available < (unsigned int)max)
+        max = available;
+    for (n = 0; n < max; n++)
+        data[n] = cb->buffer[(tail + n) & (BUFFER_SIZE - 1)];
+    cb->tail = tail + max;
+    
+    return max;
+}
+
+// Number of chars waiting to be popped
+unsigned int cb_pending(volatile CircularBuffer *cb) {
+    return cb->head - cb->tail;
+}
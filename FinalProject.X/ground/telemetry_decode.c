@@ -0,0 +1,93 @@
+/*
+ * File:   telemetry_decode.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Prints the telemetry received from the buggy, binary records decoded and
+// ASCII messages as they are, then the decoding statistics on stderr. Reads
+// a capture file or a serial port already configured (stty -F /dev/ttyUSB0
+// 9600 raw), or stdin, e.g. firmware_host -u | telemetry_decode.
+// With -t the chunks of a trace dump ($PTRC,2*) are written to trace.bin,
+// the input of host/replay. A chunk that does not start where the previous
+// one ended (a lost frame) is reported as a gap, and the exit status is 1.
+//
+// Usage: telemetry_decode [-t trace.bin] [file]
+
+#include "tlm_ground.h"
+#include <stdio.h>
+#include <unistd.h>
+
+static void print_record(const tlm_record* r){
+    switch (r->type) {
+        case TLM_REC_SNAPSHOT:
+            printf("TLM dist %.2f cm  batt %u.%02u V  surge %d  yaw %d  pwm %u %u %u %u  state %u\n",
+                   r->distance / 16.0, r->battery / 100, r->battery % 100, r->surge, r->yaw_rate,
+                   r->duty[0], r->duty[1], r->duty[2], r->duty[3], r->state);
+            break;
+        case TLM_REC_TRACE:
+            printf("TRC offset %u  %d bytes\n", r->offset, r->len);
+            break;
+    }
+}
+
+int main(int argc, char** argv){
+    FILE* in = stdin;
+    tlm_decoder d;
+    tlm_record rec;
+    const char* line;
+    const char* trace_file = NULL;
+    FILE* trace = NULL;
+    unsigned long trace_len = 0, trace_next = 0, trace_gaps = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:")) != -1) {
+        if (c != 't') {
+            fprintf(stderr, "usage: %s [-t trace.bin] [file]\n", argv[0]);
+            return 2;
+        }
+        trace_file = optarg;
+    }
+    if (argc - optind > 1) {
+        fprintf(stderr, "usage: %s [-t trace.bin] [file]\n", argv[0]);
+        return 2;
+    }
+    if (argc - optind == 1 && (in = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (trace_file && (trace = fopen(trace_file, "wb")) == NULL) {
+        perror(trace_file);
+        return 1;
+    }
+
+    tlm_decoder_init(&d);
+    while ((c = getc(in)) != EOF) {
+        switch (tlm_decoder_feed(&d, c, &rec, &line)) {
+            case TLM_RECORD:
+                print_record(&rec);
+                // Chunks go at their offset, a repeated dump (offset 0) overwrites
+                // the previous one
+                if (trace && rec.type == TLM_REC_TRACE) {
+                    if (rec.offset != 0 && rec.offset != trace_next) {
+                        fprintf(stderr, "trace gap: chunk at offset %u, expected %lu\n", rec.offset, trace_next);
+                        trace_gaps++;
+                    }
+                    trace_next = rec.offset + rec.len;
+                    fseek(trace, rec.offset, SEEK_SET);
+                    fwrite(rec.data, 1, rec.len, trace);
+                    if (rec.offset + rec.len > trace_len)
+                        trace_len = rec.offset + rec.len;
+                }
+                break;
+            case TLM_ASCII:  fputs(line, stdout); break;
+        }
+    }
+
+    fprintf(stderr, "bytes %lu  frames %lu (%lu bytes)  ascii %lu  crc errors %lu  bad frames %lu\n",
+            d.bytes, d.frames, d.frame_bytes, d.lines, d.crc_errors, d.bad_frames);
+    if (trace) {
+        fclose(trace);
+        fprintf(stderr, "trace %lu bytes written to %s, %lu gaps\n", trace_len, trace_file, trace_gaps);
+    }
+    return trace_gaps != 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * File:   tlm_ground.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "tlm_ground.h"
+#include <string.h>
+
+void tlm_decoder_init(tlm_decoder* d){
+    memset(d, 0, sizeof(*d));
+}
+
+// Little endian 16 bit signed field
+static int get16(const unsigned char* p){
+    return (short)(p[0] | p[1] << 8);
+}
+
+// Fields of a record, checking that the length matches its type.
+// Returns 1 if the record is valid
+int tlm_parse_record(const unsigned char* data, int len, tlm_record* rec){
+    memset(rec, 0, sizeof(*rec));
+    if (len < 1)
+        return 0;
+    rec->type = data[0];
+    switch (data[0]) {
+        case TLM_REC_SNAPSHOT:
+            if (len != TLM_SNAPSHOT_LEN)
+                return 0;
+            rec->distance = get16(data + 1);
+            rec->battery = (unsigned short)get16(data + 3);
+            rec->surge = get16(data + 5);
+            rec->yaw_rate = get16(data + 7);
+            memcpy(rec->duty, data + 9, 4);
+            rec->state = data[13];
+            return 1;
+        case TLM_REC_TRACE:
+            if (len < TLM_TRACE_LEN(0) || len > TLM_TRACE_LEN(TLM_TRACE_CHUNK))
+                return 0;
+            rec->offset = (unsigned short)get16(data + 1);
+            rec->len = len - TLM_TRACE_LEN(0);
+            memcpy(rec->data, data + 3, rec->len);
+            return 1;
+    }
+    return 0;
+}
+
+// Encode a record as the firmware would. Returns the frame length, frame
+// must have room for TLM_MAX_FRAME bytes
+int tlm_encode(const tlm_record* rec, unsigned char* frame){
+    unsigned char data[TLM_MAX_RECORD];
+    int len;
+
+    switch (rec->type) {
+        case TLM_REC_SNAPSHOT:
+            len = tlm_record_snapshot(data, rec->distance, rec->battery, rec->surge,
+                                      rec->yaw_rate, rec->duty, rec->state);
+            break;
+        case TLM_REC_TRACE:
+            len = tlm_record_trace(data, rec->offset, rec->data, rec->len);
+            break;
+        default:
+            return 0;
+    }
+    return tlm_frame(data, len, frame);
+}
+
+// Decode a complete frame (delimiter excluded)
+static int decode_frame(tlm_decoder* d, tlm_record* rec){
+    unsigned char raw[TLM_LINE_MAX];
+    int n = tlm_cobs_decode(d->buf, d->len, raw);
+
+    if (n < 3) {
+        d->bad_frames++;
+        return TLM_NONE;
+    }
+    if (tlm_crc16(raw, n - 2) != (unsigned int)(raw[n - 2] | raw[n - 1] << 8)) {
+        d->crc_errors++;
+        return TLM_NONE;
+    }
+    if (!tlm_parse_record(raw, n - 2, rec)) {
+        d->bad_frames++;
+        return TLM_NONE;
+    }
+    d->frames++;
+    d->frame_bytes += d->len + 1;
+    return TLM_RECORD;
+}
+
+// Feed one received byte. ASCII messages start with '$' and end with '\n',
+// anything else is a binary frame ending with 0x00
+int tlm_decoder_feed(tlm_decoder* d, unsigned char byte, tlm_record* rec, const char** line){
+    int result = TLM_NONE;
+
+    d->bytes++;
+    if (d->len == 0 && !d->overflow && !d->ascii && byte == '$')
+        d->ascii = 1;
+
+    if (d->ascii) {
+        if (byte == 0) {            // Lost sync, a frame ends here
+            d->len = 0;
+            d->ascii = 0;
+            d->overflow = 0;
+            return TLM_NONE;
+        }
+        if (d->len < TLM_LINE_MAX)
+            d->buf[d->len++] = byte;
+        if (byte == '\n') {
+            d->buf[d->len] = '\0';
+            *line = (const char*)d->buf;
+            d->lines++;
+            d->len = 0;
+            d->ascii = 0;
+            result = TLM_ASCII;
+        }
+        return result;
+    }
+
+    if (byte == 0) {
+        if (d->overflow)
+            d->bad_frames++;
+        else if (d->len > 0)
+            result = decode_frame(d, rec);
+        d->len = 0;
+        d->overflow = 0;
+    } else if (d->len < TLM_LINE_MAX) {
+        d->buf[d->len++] = byte;
+    } else {
+        d->overflow = 1;
+    }
+    return result;
+}
@@ -0,0 +1,54 @@
+/*
+ * File:   tlm_ground.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef TLM_GROUND_H
+#define	TLM_GROUND_H
+
+#include "telemetry.h"
+
+// Ground side of the binary telemetry (telemetry.h): a byte stream decoder
+// that separates COBS frames from the ASCII messages sharing the link, and
+// an encoder producing the same frames as the firmware.
+
+// Decoded record
+typedef struct {
+    int type;               // TLM_REC_*
+    int distance;           // 1/16 cm
+    unsigned int battery;   // Centivolts
+    int surge;              // %
+    int yaw_rate;           // %
+    unsigned char duty[4];  // OC1..OC4 in %
+    unsigned char state;
+    unsigned int offset;    // TLM_REC_TRACE: position of the chunk in the trace
+    int len;                // and its length
+    unsigned char data[TLM_TRACE_CHUNK];
+} tlm_record;
+
+#define TLM_LINE_MAX 128
+
+typedef struct {
+    unsigned char buf[TLM_LINE_MAX + 1];
+    int len;
+    int ascii;              // Collecting an ASCII message
+    int overflow;           // Dropping bytes up to the next delimiter
+    unsigned long bytes;
+    unsigned long frames;       // Valid binary frames
+    unsigned long frame_bytes;  // Bytes of the valid binary frames, delimiters included
+    unsigned long crc_errors;
+    unsigned long bad_frames;   // Invalid COBS, unknown types or wrong lengths
+    unsigned long lines;        // ASCII messages
+} tlm_decoder;
+
+// tlm_decoder_feed results
+#define TLM_NONE   0
+#define TLM_RECORD 1        // *rec holds a record
+#define TLM_ASCII  2        // *line points to an ASCII message, '\n' included
+
+void tlm_decoder_init(tlm_decoder* d);
+int tlm_decoder_feed(tlm_decoder* d, unsigned char byte, tlm_record* rec, const char** line);
+int tlm_parse_record(const unsigned char* data, int len, tlm_record* rec);
+int tlm_encode(const tlm_record* rec, unsigned char* frame);
+
+#endif	/* TLM_GROUND_H */
@@ -0,0 +1,445 @@
+/*
+ * File:   hal.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+
+// Interrupt Service Routine for Timer1: one control period has elapsed
+void __attribute__((__interrupt__,__auto_psv__)) _T1Interrupt(){
+    IFS0bits.T1IF = 0;
+    isr_control_period();
+}
+
+// INT2 is not wired to a pin: its flag is set by software (hal_soft_irq_post)
+// to run the command job at IPL_COMMANDS
+void __attribute__((__interrupt__,__auto_psv__)) _INT2Interrupt(){
+    IFS1bits.INT2IF = 0;
+    isr_commands();
+}
+
+// Interrupt Service Routine for INT1
+void __attribute__((__interrupt__,__auto_psv__)) _INT1Interrupt(){
+    IFS1bits.INT1IF = 0;
+    IEC1bits.INT1IE = 0;      // Masked until the debounce period is over
+    isr_button_pressed();
+}
+
+// Interrupt Service Routine for Timer2
+void __attribute__((__interrupt__,__auto_psv__)) _T2Interrupt(){
+    IFS0bits.T2IF = 0;
+    T2CONbits.TON = 0;
+    isr_debounce_elapsed();
+    IEC1bits.INT1IE = 1;
+}
+
+static volatile unsigned int hal_uart_overruns;
+
+// Interrupt handler for the char recevied on UART2
+void __attribute__((__interrupt__, __auto_psv__)) _U2RXInterrupt() {
+    IFS1bits.U2RXIF = 0;         // Reset UART2 Receiver Interrupt Flag Status bit
+    while (U2STAbits.URXDA)      // Hand the chars received to the application, all
+        isr_uart_rx(U2RXREG);    // four of the FIFO after a flash stall
+    if (U2STAbits.OERR) {        // The FIFO overflowed: the UART receives nothing
+        U2STAbits.OERR = 0;      // more until OERR is cleared
+        hal_uart_overruns++;
+    }
+}
+
+// Interrupt handler for UART2 transmit FIFO space
+void __attribute__((__interrupt__, __auto_psv__)) _U2TXInterrupt() {
+    IFS1bits.U2TXIF = 0;         // Set again by the hardware when a char moves to the shift register
+    isr_uart_tx();               // Refill the FIFO from the transmit queue
+}
+
+// Disable analog inputs and set all buggy's lights as output
+void hal_board_init(void){
+    ANSELA = ANSELB = ANSELC = ANSELD = ANSELE = ANSELG = 0x0000;
+
+    TRISAbits.TRISA0 = 0; // Led1 (RA0)
+    TRISBbits.TRISB8 = 0; // Left Side Lights (RB8)
+    TRISFbits.TRISF1 = 0; // Right Side Lights (RF1)
+    TRISAbits.TRISA7 = 0; // Beam Headlights (RA7)
+    TRISFbits.TRISF0 = 0; // Brakes (RF0)
+    TRISGbits.TRISG1 = 0; // Low Intensity Lights (RG1)
+
+    // DSP engine: signed fractional multiplies, conventional rounding and
+    // saturation of the stores (filters in filter.c)
+    CORCONbits.IF = 0;
+    CORCONbits.US = 0;
+    CORCONbits.RND = 1;
+    CORCONbits.SATDW = 1;
+}
+
+// Configure INT1 on the RE8 button and enable the interrupts used by the firmware
+void hal_interrupts_init(void){
+    TRISEbits.TRISE8 = 1;     // Set RE8 as input
+    RPINR0bits.INT1R = 0x58;  // Remap RE8 to INT1 (RPI88 -> 0x58)
+    
+    // Priorities of the executive (hal.h)
+    IPC3bits.AD1IP = IPL_ADC;
+    IPC0bits.T1IP = IPL_CONTROL;
+    IPC5bits.INT1IP = IPL_DEVICE;
+    IPC1bits.T2IP = IPL_DEVICE;
+    IPC7bits.U2RXIP = IPL_DEVICE;
+    IPC7bits.U2TXIP = IPL_DEVICE;
+    IPC7bits.INT2IP = IPL_COMMANDS;
+    
+    INTCON2bits.GIE = 1;      // Enable global interrupts
+    IFS1bits.INT1IF = 0;      // Clear INT1 interrupt flag
+    IFS1bits.INT2IF = 0;
+
+    IEC1bits.INT1IE = 1;      // Enable INT1 interrupt
+    IEC0bits.T2IE = 1;        // Enable Timer2 Interrupt
+    IEC1bits.U2RXIE = 1;      // enable interrupt for UART
+    IEC1bits.INT2IE = 1;      // Command job
+}
+
+// Raise the CPU priority to ipl, masking the interrupts up to that level.
+// Returns the previous one for hal_ipl_restore; never lowers the priority,
+// so critical sections can nest and be entered from any job
+int hal_ipl_raise(int ipl){
+    int old = SRbits.IPL;
+    if (ipl > old)
+        SRbits.IPL = ipl;
+    return old;
+}
+
+void hal_ipl_restore(int ipl){
+    SRbits.IPL = ipl;
+}
+
+// Request the command job, it runs as soon as the CPU priority is below IPL_COMMANDS
+void hal_soft_irq_post(void){
+    IFS1bits.INT2IF = 1;
+}
+
+// Stop the CPU until an interrupt (Idle mode, PWRSAV #1). Timers, ADC, UART
+// and OC keep running (their xSIDL bits are clear). An enabled interrupt at or
+// below the CPU priority still wakes the CPU, its handler runs once the
+// priority drops. Sleep mode is not an option: it stops the Fcy clock of
+// Timer1 and of the PWM.
+void hal_idle(void){
+    Idle();
+}
+
+// Stop a 16 bit timer, reset its counter, load prescaler bits and period
+// register and start it again
+#define TIMER16_CONFIG(n)             \
+    T##n##CONbits.TON = 0;            \
+    TMR##n = 0;                       \
+    T##n##CONbits.TCKPS = tckps;      \
+    PR##n = period;                   \
+    T##n##CONbits.TON = 1
+
+// Same for a 32 bit pair: the even timer counts the low word and holds the
+// configuration, the odd one the high word, flag and interrupt. TMRyHLD is
+// written to the high word along with TMRx
+#define TIMER32_CONFIG(x, y)          \
+    T##x##CON = 0;                    \
+    T##y##CON = 0;                    \
+    T##x##CONbits.T32 = 1;            \
+    T##x##CONbits.TCKPS = tckps;      \
+    TMR##y##HLD = 0;                  \
+    TMR##x = 0;                       \
+    PR##y = period >> 16;             \
+    PR##x = period;                   \
+    T##x##CONbits.TON = 1
+
+// Load prescaler bits and period register (PRx, counts - 1) of a timer and start it
+void hal_timer_config(int timer, int tckps, unsigned long period){
+    switch(timer){
+        case TIMER1: TIMER16_CONFIG(1); break;
+        case TIMER2: T2CONbits.T32 = 0; TIMER16_CONFIG(2); break;
+        case TIMER3: TIMER16_CONFIG(3); break;
+        case TIMER4: T4CONbits.T32 = 0; TIMER16_CONFIG(4); break;
+        case TIMER5: TIMER16_CONFIG(5); break;
+        case TIMER23: TIMER32_CONFIG(2, 3); break;
+        case TIMER45: TIMER32_CONFIG(4, 5); break;
+    }
+}
+
+void hal_timer_stop(int timer){
+    switch(timer){
+        case TIMER1: T1CONbits.TON = 0; break;
+        case TIMER2: case TIMER23: T2CONbits.TON = 0; break;
+        case TIMER3: T3CONbits.TON = 0; break;
+        case TIMER4: case TIMER45: T4CONbits.TON = 0; break;
+        case TIMER5: T5CONbits.TON = 0; break;
+    }
+}
+
+// Enable or disable the interrupt at the end of each period, for the timers
+// that have a handler (Timer1: control job, Timer2: debounce)
+void hal_timer_irq(int timer, int enable){
+    switch(timer){
+        case TIMER1: IEC0bits.T1IE = enable; break;
+        case TIMER2: IEC0bits.T2IE = enable; break;
+    }
+}
+
+// Returns 1 if the timer period has expired since the last hal_timer_clear
+int hal_timer_elapsed(int timer){
+    switch(timer){
+        case TIMER1: return IFS0bits.T1IF;
+        case TIMER2: return IFS0bits.T2IF;
+        case TIMER3: case TIMER23: return IFS0bits.T3IF;
+        case TIMER4: return IFS1bits.T4IF;
+        case TIMER5: case TIMER45: return IFS1bits.T5IF;
+    }
+    return 0;
+}
+
+void hal_timer_clear(int timer){
+    switch(timer){
+        case TIMER1: IFS0bits.T1IF = 0; break;
+        case TIMER2: IFS0bits.T2IF = 0; break;
+        case TIMER3: case TIMER23: IFS0bits.T3IF = 0; break;
+        case TIMER4: IFS1bits.T4IF = 0; break;
+        case TIMER5: case TIMER45: IFS1bits.T5IF = 0; break;
+    }
+}
+
+// Current counter value (TMRx); reading the low word of a pair latches the
+// high word in TMRyHLD
+unsigned long hal_timer_count(int timer){
+    unsigned int lsw;
+    switch(timer){
+        case TIMER1: return TMR1;
+        case TIMER2: return TMR2;
+        case TIMER3: return TMR3;
+        case TIMER4: return TMR4;
+        case TIMER5: return TMR5;
+        case TIMER23: lsw = TMR2; return ((unsigned long)TMR3HLD << 16) | lsw;
+        case TIMER45: lsw = TMR4; return ((unsigned long)TMR5HLD << 16) | lsw;
+    }
+    return 0;
+}
+
+// Period register (PRx), the counter resets after PRx + 1 counts
+unsigned long hal_timer_period(int timer){
+    switch(timer){
+        case TIMER1: return PR1;
+        case TIMER2: return PR2;
+        case TIMER3: return PR3;
+        case TIMER4: return PR4;
+        case TIMER5: return PR5;
+        case TIMER23: return ((unsigned long)PR3 << 16) | PR2;
+        case TIMER45: return ((unsigned long)PR5 << 16) | PR4;
+    }
+    return 0;
+}
+
+// Timer4/5 as a free running 32 bit counter at Fcy, used as cycle counter
+// (wraps after about 59 s)
+void hal_cycles_init(void){
+    hal_timer_config(TIMER45, 0, 0xFFFFFFFFUL);  // 1:1 prescaler, full range
+}
+
+unsigned long hal_cycles(void){
+    unsigned int lsw = TMR4;    // Reading TMR4 latches TMR5 in TMR5HLD
+    return ((unsigned long)TMR5HLD << 16) | lsw;
+}
+
+// Interrupt handler for ADC1: a half of the result buffer is complete.
+// With BUFM = 1 the ADC fills ADC1BUF0-7 and ADC1BUF8-F alternately, so the
+// half read here is never the one being written.
+void __attribute__((__interrupt__, __auto_psv__)) _AD1Interrupt() {
+    IFS0bits.AD1IF = 0;
+    volatile unsigned int* buf = AD1CON2bits.BUFS ? &ADC1BUF0 : &ADC1BUF8;
+    
+    // Scan order is AN11, AN15: even results are the battery, odd the IR sensor
+    unsigned int battery = buf[0] + buf[2] + buf[4] + buf[6];
+    unsigned int ir = buf[1] + buf[3] + buf[5] + buf[7];
+    isr_adc(battery >> 2, ir >> 2);
+}
+
+// Scan AN11 (battery) and AN15 (IR sensor) continuously: automatic sampling
+// and conversion, interrupt every ADC_SCANS_PER_IRQ scans
+void hal_adc_init(void){
+    // IR Sensor analog configuration AN15
+    TRISBbits.TRISB15 = 1;
+    ANSELBbits.ANSB15 = 1;
+    TRISAbits.TRISA3 = 0; // IR sensor enable line
+    LATAbits.LATA3 = 1;   // Enable pin
+
+    // Enable Battery Sensor analog configuration AN11
+    TRISBbits.TRISB11 = 1;
+    ANSELBbits.ANSB11 = 1;
+
+    AD1CON3bits.ADCS = 14;  // Select Tad
+    AD1CON1bits.ASAM = 1;   // Sampling restarts right after each conversion
+    AD1CON1bits.SSRC = 7;   // Automatic conversion
+    AD1CON3bits.SAMC = 16;  // Sampling lasts 16 Tad
+    AD1CON2bits.CHPS = 0;   // Use 1-channel (CH0) mode
+    AD1CON1bits.SIMSAM = 0; // Sequential sampling
+
+    AD1CON2bits.CSCNA = 1;  // Scan mode enabled
+    AD1CSSLbits.CSS15 = 1;  // Scan for AN15 IR sensor
+    AD1CSSLbits.CSS11 = 1;  // Scan for AN11 Battery sensor
+    AD1CON2bits.SMPI = 2 * ADC_SCANS_PER_IRQ - 1; // Conversions per interrupt - 1
+    AD1CON2bits.BUFM = 1;   // Fill the two halves of ADC1BUF alternately
+
+    IFS0bits.AD1IF = 0;
+    IEC0bits.AD1IE = 1;     // Enable ADC1 interrupt
+    AD1CON1bits.ADON = 1;   // Turn on the ADC module
+}
+
+// Setup UART2 (mounted on mikroBUS2)
+void hal_uart_init(long baud){
+    // From documentation (pag.9 datasheet):
+    // RD0(RP64) -> TX
+    // RD11(RPI75) -> RX
+    // For Transitter: Find 'OUTPUT SELECTION FOR REMAPPABLE PINS' in datasheet
+    // Under U2TX -> 000011 -> 0x03 in hex
+    // For Receiver: Find 'INPUT PIN SELECTION FOR SELECTABLE INPUT SOURCES' in datasheet
+    // Under RPI75 -> 1001011 -> 0x4B
+
+    RPOR0bits.RP64R = 0x03;   //Map UART2 TX to pin RD0 which is RP64
+    RPINR19bits.U2RXR = 0x4B; //Map UART2 RX to pin RD11 which is RPI75
+
+    U2BRG = FCY / (16L * baud) - 1;
+    U2MODEbits.UARTEN = 1;    // Enable UART
+    U2STAbits.UTXISEL0 = 0;   // TX interrupt when a char is transferred to the
+    U2STAbits.UTXISEL1 = 0;   // shift register (at least one free FIFO slot)
+    U2STAbits.UTXEN = 1;      // Enable Transmission (must be after UARTEN)
+}
+
+int hal_uart_tx_full(void){
+    return U2STAbits.UTXBF;
+}
+
+void hal_uart_write(char data){
+    U2TXREG = data;
+}
+
+void hal_uart_rx_irq(int enable){
+    IEC1bits.U2RXIE = enable;
+}
+
+// Receive FIFO overruns, chars were lost at each of them
+unsigned int hal_uart_rx_overruns(void){
+    return hal_uart_overruns;
+}
+
+void hal_uart_tx_irq(int enable){
+    IEC1bits.U2TXIE = enable;
+}
+
+// Edge-aligned PWM on OC1..OC4, all with the same period. OC1 runs on its
+// own, OC2..OC4 are synchronized to it so that the four periods start together
+void hal_oc_init(unsigned int period){
+
+    //OC1 010000 RPn tied to Output Compare 1 Output
+    //OC2 010001 RPn tied to Output Compare 2 Output
+    //OC3 010010 RPn tied to Output Compare 3 Output
+    //OC4 010011 RPn tied to Output Compare 4 Output
+
+    RPOR0bits.RP65R = 0x10; // RD1 is RP65 (OC1: 010000 -> 0x10 in hex)
+    RPOR1bits.RP66R = 0x11; // RD2 is RP66 (OC2: 010001 -> 0x11 in hex)
+    RPOR1bits.RP67R = 0x12; // RD3 is RP67 (OC3: 010010 -> 0x12 in hex)
+    RPOR2bits.RP68R = 0x13; // RD4 is RP68 (OC4: 010011 -> 0x13 in hex)
+
+    // OC1: left wheels anticlockwise
+    OC1CON1bits.OCTSEL = 7;     // Selects the peripheral clock (111 = 7) as the clock source to the OC module
+    OC1CON1bits.OCM = 6;        // Configures the OC module in Edge-Aligned PWM mode (110 = 6)
+    OC1CON2bits.SYNCSEL = 0x1F; // Specifies that the OC module is synchronized to itself, meaning it operates independently without external synchronization: Tpwm = Tcy (11111 = 1f)
+
+    // OC2: left wheels clockwise
+    OC2CON1bits.OCTSEL = 7;
+    OC2CON1bits.OCM = 6;
+    OC2CON2bits.SYNCSEL = 0x01; // Synchronized to OC1 (00001)
+
+    // OC3: right wheels anticlockwise
+    OC3CON1bits.OCTSEL = 7;
+    OC3CON1bits.OCM = 6;
+    OC3CON2bits.SYNCSEL = 0x01;
+
+    // OC4: right wheels clockwise
+    OC4CON1bits.OCTSEL = 7;
+    OC4CON1bits.OCM = 6;
+    OC4CON2bits.SYNCSEL = 0x01;
+
+    // OCxRS define the max period
+    OC1RS = OC2RS = OC3RS = OC4RS = period;
+
+    // Setup OCxR to 0 at start
+    OC1R = OC2R = OC3R = OC4R = 0;
+}
+
+// Load the compare values of the channels in mask (bit k: OCk+1). In PWM mode
+// OCxR is double-buffered and taken at the start of the next period, the same
+// for the four channels: the writes are done with the interrupts masked and
+// not in the last HAL_OC_GUARD counts of a period, so they all land at the
+// same boundary
+void hal_oc_write(const unsigned int duty[4], int mask){
+    int ipl = hal_ipl_raise(7);  // All the interrupts, for at most HAL_OC_GUARD cycles and the writes
+    
+    while (OC1TMR + HAL_OC_GUARD > OC1RS)
+        ;
+    if (mask & 1) OC1R = duty[0];
+    if (mask & 2) OC2R = duty[1];
+    if (mask & 4) OC3R = duty[2];
+    if (mask & 8) OC4R = duty[3];
+    hal_ipl_restore(ipl);
+}
+
+// Program flash kept for data: HAL_FLASH_PAGES erase pages, aligned on a page.
+// A 16 bit item of a space(prog) array takes the low word of an instruction,
+// so a data byte offset is also the offset of its program address. Loaded
+// erased: programming the firmware starts from an empty area
+#define HAL_FLASH_PAGE_PC 0x800UL  // Program addresses per page (1024 instructions)
+static const unsigned int __attribute__((space(prog), aligned(_FLASH_PAGE * 2)))
+    hal_flash_area[HAL_FLASH_PAGES * HAL_FLASH_PAGE_SIZE / 2] = { [0 ... HAL_FLASH_PAGES * HAL_FLASH_PAGE_SIZE / 2 - 1] = 0xFFFF };
+
+static unsigned long hal_flash_address(int page, unsigned int offset){
+    return __builtin_tbladdress(hal_flash_area) + page * HAL_FLASH_PAGE_PC + (offset & ~1U);
+}
+
+void hal_flash_read(int page, unsigned int offset, void* data, unsigned int len){
+    unsigned char* p = data;
+    unsigned long addr = hal_flash_address(page, offset);
+    unsigned int word;
+
+    while (len--) {
+        TBLPAG = addr >> 16;
+        word = __builtin_tblrdl(addr & 0xFFFF);
+        if (offset++ & 1) {
+            *p++ = word >> 8;
+            addr += 2;
+        } else {
+            *p++ = word;
+        }
+    }
+}
+
+// Start the NVM operation loaded in NVMCON at addr and wait for its end: the
+// CPU stalls while the flash is programmed (about 50 us for a double word,
+// 20 ms for a page erase), interrupts included. Returns -1 on WRERR
+static int hal_flash_operation(unsigned long addr){
+    NVMADRU = addr >> 16;
+    NVMADR = addr & 0xFFFF;
+    __builtin_write_NVM();  // Unlock sequence and WR, interrupts disabled meanwhile
+    while (NVMCONbits.WR)
+        ;
+    return NVMCONbits.WRERR ? -1 : 0;
+}
+
+// Program the HAL_FLASH_WORD bytes at offset (a multiple of HAL_FLASH_WORD),
+// through the write latches at 0xFA0000. The upper bytes of the instructions
+// stay erased
+int hal_flash_program(int page, unsigned int offset, const unsigned char data[HAL_FLASH_WORD]){
+    NVMCON = 0x4001;  // WREN, double word program
+    TBLPAG = 0xFA;
+    __builtin_tblwtl(0, data[0] | (data[1] << 8));
+    __builtin_tblwth(0, 0xFF);
+    __builtin_tblwtl(2, data[2] | (data[3] << 8));
+    __builtin_tblwth(2, 0xFF);
+    return hal_flash_operation(hal_flash_address(page, offset));
+}
+
+int hal_flash_erase(int page){
+    NVMCON = 0x4003;  // WREN, page erase
+    return hal_flash_operation(hal_flash_address(page, 0));
+}
@@ -0,0 +1,143 @@
+/*
+ * File:   hal.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef HAL_H
+#define	HAL_H
+
+// Thin hardware abstraction layer: this file (and hal.c) are the only places
+// where the dsPIC registers are touched. When HOST_BUILD is defined the same
+// names are served by the simulated register backend in host/hal_sim.c, so
+// main.c and functions.c build unchanged on Linux.
+
+// ADC channels, in scan order (AN11 first, then AN15)
+#define ADC_BATTERY 0
+#define ADC_IR      1
+#define ADC_SCANS_PER_IRQ 4  // Scans averaged by each ADC interrupt (half of ADC1BUF)
+
+// Interrupt priority levels (IPL). The firmware is a run-to-completion
+// executive: the control job runs from Timer1, the command job from INT2
+// used as a software interrupt, the tasks in the background loop at IPL 0.
+// A job only waits for the higher levels and for the critical sections
+// that raise the IPL (hal_ipl_raise) to its level.
+#define IPL_ADC      6  // ADC1: above control, so no half of ADC1BUF is lost while it runs
+#define IPL_CONTROL  5  // Timer1: control job
+#define IPL_DEVICE   4  // U2RX, U2TX, INT1, Timer2: move a byte or a flag and return
+#define IPL_COMMANDS 3  // INT2, posted by U2RX: parse and apply the commands
+
+// OC channels driving the wheels
+#define OC_LEFT_CCW  0  // OC1
+#define OC_LEFT_CW   1  // OC2
+#define OC_RIGHT_CCW 2  // OC3
+#define OC_RIGHT_CW  3  // OC4
+
+// Program flash kept for data (hal_flash_*): erase pages of 1024 instructions,
+// of which only the low 16 bits are used, programmed one double word (two
+// instructions, 4 data bytes) at a time. Programming only clears bits, a byte
+// is back to 0xFF after the erase of its page
+#define HAL_FLASH_PAGES     2
+#define HAL_FLASH_PAGE_SIZE 2048  // Data bytes per page
+#define HAL_FLASH_WORD      4     // Data bytes per program operation
+#define HAL_FLASH_PROGRAM_US 47     // CPU stall of a program operation
+#define HAL_FLASH_ERASE_US   20000  // CPU stall of a page erase
+
+// OCxR writes wait for the OC1 timer to be at least HAL_OC_GUARD counts (Tcy)
+// from the end of the period, with all the interrupts masked (hal_oc_write)
+#define HAL_OC_GUARD 64
+
+#ifndef HOST_BUILD
+
+#include <xc.h>
+
+// GPIO lines (used through hal_gpio_write/read/toggle with the suffix only)
+#define HAL_GPIO_LED_A0    LATAbits.LATA0  // Led1
+#define HAL_GPIO_LEFT      LATBbits.LATB8  // Left Side Lights
+#define HAL_GPIO_RIGHT     LATFbits.LATF1  // Right Side Lights
+#define HAL_GPIO_BEAM      LATAbits.LATA7  // Beam Headlights
+#define HAL_GPIO_BRAKES    LATFbits.LATF0  // Brakes
+#define HAL_GPIO_LOW       LATGbits.LATG1  // Low Intensity Lights
+#define HAL_GPIO_IR_ENABLE LATAbits.LATA3  // IR sensor enable line
+#define HAL_GPIO_BUTTON    PORTEbits.RE8   // Start/stop button (INT1)
+
+// Output compare registers: duty (OCxR) and period (OCxRS)
+#define HAL_OC1R  OC1R
+#define HAL_OC2R  OC2R
+#define HAL_OC3R  OC3R
+#define HAL_OC4R  OC4R
+#define HAL_OC1RS OC1RS
+#define HAL_OC2RS OC2RS
+#define HAL_OC3RS OC3RS
+#define HAL_OC4RS OC4RS
+
+// DSP engine, accumulator A in fractional mode (CORCON.IF = 0): a MAC of two
+// Q15 operands adds their product to bits 31..0 of the 40 bit accumulator and
+// SAC.R stores bits 31..16 rounded and saturated (hal_board_init sets them up).
+// LAC32 and SAC32 load and store bits 31..0 as a long, the low word through ACCAL
+#define HAL_ACC_DECLARE(a)   register int a asm("A")
+#define HAL_ACC_CLR(a)       (a = __builtin_clr())
+#define HAL_ACC_LAC(a, v)    (a = __builtin_lac(v, 0))
+#define HAL_ACC_LAC32(a, v)  (a = __builtin_lac((int)((v) >> 16), 0), ACCAL = (unsigned int)(v))
+#define HAL_ACC_MAC(a, x, y) (a = __builtin_mac(a, x, y, 0, 0, 0, 0, 0, 0, 0, 0))
+#define HAL_ACC_SACR(a)      __builtin_sacr(a, 0)
+#define HAL_ACC_SAC32(a)     ((long)__builtin_sac(a, 0) << 16 | ACCAL)
+
+#else
+
+#include "host/hal_sim.h"
+
+#endif
+
+#define hal_gpio_write(pin, value) (HAL_GPIO_##pin = (value))
+#define hal_gpio_read(pin)         (HAL_GPIO_##pin)
+#define hal_gpio_toggle(pin)       (HAL_GPIO_##pin = !HAL_GPIO_##pin)
+
+// Board related functions
+void hal_board_init(void);
+void hal_interrupts_init(void);
+int hal_ipl_raise(int ipl);
+void hal_ipl_restore(int ipl);
+void hal_soft_irq_post(void);
+void hal_idle(void);
+
+// Timer related functions
+void hal_timer_config(int timer, int tckps, unsigned long period);
+void hal_timer_stop(int timer);
+int hal_timer_elapsed(int timer);
+void hal_timer_clear(int timer);
+unsigned long hal_timer_count(int timer);
+unsigned long hal_timer_period(int timer);
+void hal_timer_irq(int timer, int enable);
+void hal_cycles_init(void);
+unsigned long hal_cycles(void);
+
+// ADC related functions
+void hal_adc_init(void);
+
+// UART related functions
+void hal_uart_init(long baud);
+int hal_uart_tx_full(void);
+void hal_uart_write(char data);
+void hal_uart_rx_irq(int enable);
+unsigned int hal_uart_rx_overruns(void);
+void hal_uart_tx_irq(int enable);
+
+// PWM related functions
+void hal_oc_init(unsigned int period);
+void hal_oc_write(const unsigned int duty[4], int mask);
+
+// Flash related functions
+void hal_flash_read(int page, unsigned int offset, void* data, unsigned int len);
+int hal_flash_program(int page, unsigned int offset, const unsigned char data[HAL_FLASH_WORD]);
+int hal_flash_erase(int page);
+
+// Callbacks invoked by the interrupt vectors owned by the HAL
+void isr_uart_rx(char data);
+void isr_uart_tx(void);
+void isr_adc(unsigned int battery, unsigned int ir);
+void isr_button_pressed(void);
+void isr_debounce_elapsed(void);
+void isr_control_period(void);
+void isr_commands(void);
+
+#endif	/* HAL_H */
@@ -1,112 +1,493 @@
-/*
- * File:   headers.h
- * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
- */
-
-#ifndef HEADER_H
-#define	HEADER_H
-
-#include <xc.h> 
-
-// System Clock Configuration
-#define FOSC 144000000  // Fosc = Fin*(M/(N1*N2)) = 8Mhz*(72/(2*2)) = 144MHz
-#define FCY (FOSC / 2)  // Fcy = Fosc/2 = 72MHz
-
-// Timer Configuration
-#define TIMER1 1
-#define TIMER2 2
-#define MaxInt 65535  // Max number that can be represented with 16bit register 
-
-// Message Parsing States
-#define STATE_DOLLAR  1 // we discard everything until a dollar is found
-#define STATE_TYPE    2 // we are reading the type of msg until a comma is found
-#define STATE_PAYLOAD 3 // we read the payload until an asterix is found
-#define NEW_MESSAGE   1 // new message received and parsed completely
-#define NO_MESSAGE    0 // no new messages
-
-// Measurement Flags
-#define DISTANCE 1
-#define BATTERY  0
-
-#define BUFFER_SIZE 13  // 9.6 byte/s -> 10 is just enough, 13: final size of cb (10 + 25%(10)) 
-#define MAX_TASKS 5
-
-// State Machine States
-typedef enum {
-    WaitForStart,
-    Moving
-} State;
-
-// Control Data Structure
-typedef struct {
-    int MINTH;
-    int MAXTH;
-    int yaw_rate;
-    int surge;
-    State state;
-} ControlData;
-
-// CircularBuffer structure
-typedef struct {
-    char buffer[BUFFER_SIZE];
-    int head;
-    int tail;
-    int to_read;
-} CircularBuffer;
-
-// Parser State Structure
-typedef struct { 
-	int state;
-	char msg_type[6];       // Type is 5 chars + string terminator
-	char msg_payload[100];  // Payload cannot exceed 100 chars
-	int index_type;
-	int index_payload;
-} parser_state;
-
-// Heartbeat Structure
-typedef struct {
-    int n;
-    int N;
-    int enable;
-    void (*f)(void *);
-    void* params;
-} heartbeat;
-
-// LED related functions
-void LigthsSetup();
-
-// Timer related functions
-void tmr_setup_period(int timer, int ms); 
-void tmr_wait_period(int timer);
-
-// ADC related functions
-void ADCsetup();
-float getMeasurements(int flag);
-
-// PWM related functions
-void PWMsetup(int PWM_freq);
-void PWMstop();
-void PWMstart(ControlData* data);
-
-// UART related functions
-void UARTsetup();
-void send_uart(char* data);
-
-// Circular Buffer related functions
-void cb_push(volatile CircularBuffer *cb, char data);
-int cb_pop(volatile CircularBuffer *cb, char *data);
-
-// Parser related functions
-int parse_byte(parser_state* ps, char byte);
-int extract_integer(const char* str);
-int next_value(const char* msg, int i);
-
-// Scheduler related functions
-void scheduler(heartbeat schedInfo[], int nTasks);
-void task_blinkA0 (void* param);
-void task_blink_indicators (void* param);
-void task_send_distance(void* param);
-void task_send_battery(void* param);
-void task_send_dutycycle(void* param);
-
+/*
+ * File:   headers.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef HEADER_H
+#define	HEADER_H
+
+// System Clock Configuration
+#define FOSC 144000000  // Fosc = Fin*(M/(N1*N2)) = 8Mhz*(72/(2*2)) = 144MHz
+#define FCY (FOSC / 2)  // Fcy = Fosc/2 = 72MHz
+
+// Timer Configuration
+#define TIMER1 1
+#define TIMER2 2
+#define TIMER3 3
+#define TIMER4 4
+#define TIMER5 5
+#define TIMER23 6     // Timer2 and Timer3 as a 32 bit timer (flag and interrupt of Timer3)
+#define TIMER45 7     // Timer4 and Timer5 as a 32 bit timer, the cycle counter (hal_cycles)
+
+// Message Parsing States
+#define STATE_DOLLAR  1 // we discard everything until a dollar is found
+#define STATE_TYPE    2 // we are reading the type of msg until a comma is found
+#define STATE_PAYLOAD 3 // we read the payload until an asterix is found
+#define NEW_MESSAGE   1 // new message received and parsed completely
+#define NO_MESSAGE    0 // no new messages
+
+// Fixed-point formats and control parameters
+#define DIST_FRAC_BITS 4                  // Distances are in 1/16 cm
+#define DIST_ONE (1 << DIST_FRAC_BITS)
+#define Q15_ONE 32767                     // 1.0 in Q15
+#define SURGE_GAIN 2                      // Default surge gain: surge = 2 * d
+#define YAW_SCALE 500                     // Default yaw scale: yaw = 500 / d
+#define MOTOR_DEAD_TIME_MS 2              // Default dead time of a wheel reversal ($PDTM)
+
+// Telemetry modes, selected with $PTLM
+#define TELEMETRY_ASCII  0  // $Mxxx messages
+#define TELEMETRY_BINARY 1  // COBS framed records (telemetry.h)
+
+// Measurement Flags
+#define DISTANCE 1
+#define BATTERY  0
+
+// ADC conversion tables (adc_lut.c, generated by tools/gen_adc_lut.py)
+#define ADC_LUT_SHIFT 3   // One entry every 8 ADC codes, linear interpolation in between
+#define ADC_LUT_SIZE ((1024 >> ADC_LUT_SHIFT) + 1)
+
+#define BUFFER_SIZE 16  // Power of two: 9.6 byte/s -> 10 is just enough, 13 (10 + 25%(10)) rounded up
+#define TX_BUFFER_SIZE 128 // Power of two, ~130 ms of telemetry at 9600 bps
+#define MAX_TASKS 5
+#define SCHED_MAX_TASKS 32    // Most tasks a scheduler_init() call can take
+#define RX_CHUNK 16           // Bytes the command job pops from the RX buffer per cb_pop_bulk() call
+#define LOOP_PERIOD_US 1000   // Control loop period, Timer1 (200 for 5 kHz)
+#define LOOP_TICKS_MS(ms) ((ms) * 1000L / LOOP_PERIOD_US)  // Control loop periods in ms
+#define PERF_BINS 8           // Bins of the cycle histograms (PerfStats)
+// Longest telemetry message, string terminator included: $MPERF with every
+// field at its widest, ",<unsigned long>" for stage, min, max and overruns
+// and ",65535" for the bins, then "*\n"
+#define MSG_MAX_LEN (6 + 4 * 11 + PERF_BINS * 6 + 2 + 1)
+
+// State Machine States
+typedef enum {
+    WaitForStart,
+    Moving
+} State;
+
+// Control Data Structure
+typedef struct {
+    int MINTH;
+    int MAXTH;
+    int yaw_rate;
+    int surge;
+    State state;
+    int surge_gain;   // surge = surge_gain * d (percent per cm)
+    int yaw_scale;    // yaw = yaw_scale / d (percent * cm)
+    int law;          // LAW_PROPORTIONAL or LAW_PID
+} ControlData;
+
+// Control laws of the Moving state
+#define LAW_PROPORTIONAL 0  // Thresholds and proportional terms (control_law)
+#define LAW_PID          1  // Surge and yaw PIDs (control_pid)
+
+// Fixed-point PID (control.c). Errors are in 1/16 cm and outputs in percent.
+// Gains are Q8: kp in %/cm, ki in %/(cm s) and kd in % s/cm; they are
+// discretized for the controller period (ki * T and kd / T) and the terms
+// are accumulated in Q12 percent. The integral is clamped to the output
+// range (anti-windup); the derivative acts on the measurement, so that a
+// setpoint change does not kick the output, and is low-pass filtered.
+#define PID_GAIN_BITS 8
+#define PID_FRAC_BITS (PID_GAIN_BITS + DIST_FRAC_BITS)
+#define PID_GAIN_Q8(centi) ((long)(centi) * (1L << PID_GAIN_BITS) / 100)  // From hundredths
+#define PID_I_BITS 8            // Extra fraction bits of ki_step and of the integral
+#define PID_D_SHIFT 2           // Derivative filter: D += (D_raw - D) >> PID_D_SHIFT
+#define PID_MAX_DELTA (10 * DIST_ONE)  // Measurement change per step used by D, bounds the products
+#define PID_PERIOD_MS 10        // Default period, the loop runs at 1 kHz
+
+typedef struct {
+    long kp, ki, kd;            // Q8 gains
+    long ki_step, kd_step;      // Discretized for period_ms, ki_step in Q16
+    int period_ms;
+    long integ;                 // Q20 %
+    long deriv;                 // Filtered derivative term, Q12 %
+    int prev_input;
+    int started;                // prev_input is valid
+    int out_min, out_max;       // %
+} Pid;
+
+// CircularBuffer structure: single producer (U2RX interrupt), single consumer
+// (main loop). head and tail are free running and each written by one side
+// only, so neither side has to mask the other.
+typedef struct {
+    char buffer[BUFFER_SIZE];
+    unsigned int head;        // Written by cb_push only
+    unsigned int tail;        // Written by cb_pop/cb_pop_bulk only
+    unsigned int dropped;     // Bytes discarded because the buffer was full
+    unsigned int high_water;  // Max number of bytes pending at once
+} CircularBuffer;
+
+// UART transmit queue, filled by the main loop and drained by the U2TX interrupt.
+// head and tail are free running and only wrapped when indexing the buffer.
+typedef struct {
+    char buffer[TX_BUFFER_SIZE];
+    unsigned int head;        // Written by send_uart only
+    unsigned int tail;        // Written by the U2TX interrupt only
+    unsigned int dropped;     // Messages discarded because the queue was full
+    unsigned int high_water;  // Max number of bytes queued at once
+} TxQueue;
+
+// Telemetry message under construction
+typedef struct {
+    char data[MSG_MAX_LEN];
+    int len;  // -1 once a field did not fit
+} Message;
+
+// Latest ADC conversion, raw codes
+typedef struct {
+    unsigned int battery;  // AN11
+    unsigned int ir;       // AN15
+} AdcSample;
+
+// Ring of the samples published by the ADC interrupt, the interrupt writes
+// sample[head % ADC_RING] and then bumps head (free running)
+#define ADC_RING 32   // Power of two, holds more than one loop period of samples
+typedef struct {
+    AdcSample sample[ADC_RING];
+    unsigned int head;
+    unsigned int lost;     // Samples overwritten before being filtered
+} AdcRing;
+
+// Filter pipeline of an ADC channel (filter.c): every sample goes through
+// FILTER_STAGES stages in order, each one a moving average, a median or an
+// exponential moving average
+#define FILTER_NONE    0
+#define FILTER_AVERAGE 1   // Mean of the last n samples
+#define FILTER_MEDIAN  2   // Median of the last n samples
+#define FILTER_EMA     3   // y += alpha * (x - y), alpha in Q15
+#define FILTER_STAGES 3
+#define FILTER_MAX_N 16
+#define FILTER_EMA_BITS 21 // Fraction bits of the EMA state, 10 bit codes fill a long
+#ifndef FILTER_DSP
+#define FILTER_DSP 1       // Average and EMA on the DSP engine, 0 for the portable C
+#endif
+
+typedef struct {
+    int kind;
+    int n;                      // Window length (average, median)
+    int coef;                   // Q15 weight: 1/n (average) or alpha (EMA)
+    int window[FILTER_MAX_N];   // Last n inputs, circular
+    int sorted[FILTER_MAX_N];   // The same in ascending order (median)
+    int pos;
+    long state;                 // EMA output, FILTER_EMA_BITS fraction bits
+    int primed;                 // Window or state seeded with the first input
+} FilterStage;
+
+typedef struct {
+    FilterStage stage[FILTER_STAGES];
+} FilterChain;
+
+// Message types packed in an integer, 6 bits per char, so that commands are
+// looked up without string comparisons. Chars from ' ' to '^' (digits and
+// upper case letters included) are packed as 1 to 63, so types of different
+// length never collide.
+#define MSG_KEY_CHAR(c) ((unsigned long)((c) - ' ' + 1))
+#define MSG_KEY4(a, b, c, d) ((((MSG_KEY_CHAR(a) << 6 | MSG_KEY_CHAR(b)) << 6) | MSG_KEY_CHAR(c)) << 6 | MSG_KEY_CHAR(d))
+#define MSG_KEY5(a, b, c, d, e) (MSG_KEY4(a, b, c, d) << 6 | MSG_KEY_CHAR(e))
+#define MSG_KEY_INVALID 0xFFFFFFFFUL  // Type with chars that cannot be packed
+
+// Parser State Structure
+// Payload fields are converted to integers while the bytes arrive, nothing
+// of the payload is stored. Bit k of field_valid is set when field k was a
+// well formed decimal integer that fits in an int.
+#define MSG_MAX_FIELDS  4   // Fields stored per message, further ones are only counted
+#define MSG_MAX_PAYLOAD 100 // Payload cannot exceed 100 chars
+typedef struct { 
+	int state;
+	char msg_type[6];       // Type is 5 chars + string terminator
+	unsigned long type_key; // msg_type packed as by MSG_KEY4/MSG_KEY5
+	int index_type;
+	int index_payload;      // Payload chars received
+	int fields[MSG_MAX_FIELDS];
+	int n_fields;           // Fields in the payload, including the ones not stored
+	unsigned int field_valid;
+	unsigned int magnitude; // Field being parsed
+	int digits;             // Digits of the field being parsed, -1 if malformed
+	int sign;               // -1 or 1 once a sign was read, 0 otherwise
+} parser_state;
+
+// Latency from the last byte of a command being received to the command being
+// applied, in microseconds
+typedef struct {
+    unsigned int count;     // Commands applied
+    unsigned long last_us;
+    unsigned long max_us;
+    unsigned long sum_us;
+} CommandStats;
+
+// Control loop timing probes (perf.c). Each stage keeps min/max cycles and a
+// histogram with one bin per power of two, from PERF_BIN0_CYCLES up. Build
+// with PERF_PROBES = 0 and PERF_BEGIN/PERF_END compile to nothing.
+#ifndef PERF_PROBES
+#define PERF_PROBES 1
+#endif
+#define PERF_BIN0_CYCLES 1024UL  // Bin 0: < 1024 cycles, bin k: < 1024 << k, last bin: the rest
+
+typedef enum {
+    PERF_ADC,       // ADC samples filtering
+    PERF_RX,        // Command job: RX parsing and command dispatch
+    PERF_STATE,     // State machine, PWM included
+    PERF_PWM,       // PWMstart/PWMstop
+    PERF_SCHED,     // scheduler, tasks included
+    PERF_LOOP,      // Whole control job
+    PERF_STAGES
+} PerfStage;
+
+typedef struct {
+    unsigned long min;
+    unsigned long max;
+    unsigned int hist[PERF_BINS];  // Saturating counters, 65 s at 1 kHz: $PPRF clears them
+} PerfStats;
+
+#if PERF_PROBES
+#define PERF_BEGIN(stage) (perf_start[stage] = hal_cycles())
+#define PERF_END(stage)   perf_record(stage, hal_cycles() - perf_start[stage])
+#else
+#define PERF_BEGIN(stage)
+#define PERF_END(stage)
+#endif
+
+// Inputs of the last control loop iteration, reported by the telemetry task
+typedef struct {
+    AdcSample sample;   // Filtered ADC codes the iteration used
+    int distance;       // 1/16 cm, converted from sample.ir
+    State state;        // State the iteration acted on
+} LoopSnapshot;
+
+// RAM trace of the control loop inputs (trace.c), dumped over UART and
+// replayed on the host (host/replay.c). It starts with TRACE_HEADER_LEN bytes:
+// 'T', 'R', TRACE_VERSION, flags and the uint32 tick of the start (little
+// endian). Then come the events, each a byte with the type in bits 7..5 and
+// the ticks since the previous event in bits 4..0 (TRACE_DELTA_ESC: a uint32
+// delta follows), then the payload of the type. The first event is the
+// configuration the recording starts with. Off unless the build sets
+// TRACE_ENABLE=1 (the host tools do): the buffer takes TRACE_SIZE bytes of
+// RAM and every iteration pays for its events.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+#define TRACE_SIZE 8192
+#define TRACE_HEADER_LEN 8
+#define TRACE_VERSION 2
+#define TRACE_FROM_BOOT 0x01    // Flag: recording started with the firmware
+#define TRACE_DELTA_ESC 31
+
+// Events
+#define TRACE_EV_ADC       0    // ADC codes of the iteration: battery | ir << 10 in 3 bytes
+#define TRACE_EV_ADC_DELTA 1    // Change of both codes in -8..7: battery << 4 | ir & 0xF
+#define TRACE_EV_RX        2    // Byte parsed by the iteration
+#define TRACE_EV_STATE     3    // State set by the button before the iteration
+#define TRACE_EV_CONFIG    4    // Running configuration: CONFIG_PAYLOAD bytes (config.c)
+
+// Trace modes
+#define TRACE_OFF    0
+#define TRACE_RECORD 1
+#define TRACE_DUMP   2          // Sending the trace, then off
+
+typedef struct {
+    unsigned char data[TRACE_SIZE];
+    unsigned int len;
+    int mode;
+    int full;                   // Recording stopped, no room for an event
+    unsigned long tick;         // Tick of the last event
+    AdcSample adc;              // Codes of the last ADC event
+    int adc_valid;
+    int state_valid;            // A STATE event has been recorded
+    unsigned int dump_pos;
+} TraceBuffer;
+
+#if TRACE_ENABLE
+#define TRACE_LOOP(tick, sample, state, last) trace_loop(tick, sample, state, last)
+#define TRACE_RX(tick, data, n)               trace_rx(tick, data, n)
+#define TRACE_SERVICE()                       trace_service()
+#else
+#define TRACE_LOOP(tick, sample, state, last)
+#define TRACE_RX(tick, data, n)
+#define TRACE_SERVICE()
+#endif
+
+// Heartbeat Structure
+// Tasks are released every N ticks, the first time phase ticks after start,
+// by the control job; they run in the background loop (scheduler_run).
+// Lateness is the time from the release to the task starting, its spread
+// (late_max_us - late_min_us) is the jitter of the task.
+typedef struct {
+    int N;
+    int phase;
+    int enable;
+    void (*f)(void *);
+    void* params;
+    unsigned long next;        // Tick of the next release
+    unsigned long released_at; // Tick of the last release
+    unsigned int released;     // Releases, counted by the control job
+    unsigned int started;      // Releases taken by the background loop
+    unsigned int runs;
+    unsigned int late_min_us;
+    unsigned int late_max_us;
+} heartbeat;
+
+// Application related functions (main.c)
+extern volatile ControlData control_data;
+extern volatile CircularBuffer cb;
+extern CommandStats cmd_stats;
+extern heartbeat schedInfo[MAX_TASKS];
+extern LoopSnapshot loop_snapshot;
+void control_setup(void);
+void control_run(const AdcSample* sample);
+void background_step(void);
+void background_idle(void);
+extern unsigned int cpu_load;
+extern unsigned long cpu_idle_cycles;
+unsigned long loop_time_us(void);
+unsigned long loop_ticks(void);
+unsigned long rx_quiet_us(void);
+
+// Timer related functions
+// Periods in microseconds, with the smallest prescaler that fits for the
+// finest resolution: up to 233 ms on the 16 bit timers, 4.4 hours on the
+// 32 bit pairs. TMR_SETUP_US() resolves prescaler and period register at
+// compile time and does not compile if the period does not fit (constant
+// arguments only); tmr_setup_us() is the same at run time, it returns the
+// error and leaves the timer untouched.
+#define TMR_OK         0
+#define TMR_ERR_TIMER -1  // Not a timer
+#define TMR_ERR_SHORT -2  // Less than 2 counts
+#define TMR_ERR_LONG  -3  // Longer than the timer reaches with the 1:256 prescaler
+
+#define TMR_CYCLES(us)             ((unsigned long long)(us) * (FCY / 1000000))
+#define TMR_COUNTS(us, presc)      ((TMR_CYCLES(us) + (presc) / 2) / (presc))  // Rounded
+#define TMR_MAX_COUNTS(timer)      ((timer) >= TIMER23 ? 0x100000000ULL : 0x10000ULL)
+#define TMR_FITS(timer, us, presc) (TMR_COUNTS(us, presc) <= TMR_MAX_COUNTS(timer))
+#define TMR_TCKPS(timer, us)       (TMR_FITS(timer, us, 1) ? 0 : TMR_FITS(timer, us, 8) ? 1 : \
+                                    TMR_FITS(timer, us, 64) ? 2 : 3)
+#define TMR_PRESCALER(tckps)       ((tckps) == 0 ? 1 : (tckps) == 1 ? 8 : (tckps) == 2 ? 64 : 256)
+#define TMR_PR(timer, us)          (TMR_COUNTS(us, TMR_PRESCALER(TMR_TCKPS(timer, us))) - 1)
+#define TMR_ERROR(timer, us) \
+    (((timer) < TIMER1 || (timer) > TIMER45) ? TMR_ERR_TIMER : \
+     !TMR_FITS(timer, us, 256) ? TMR_ERR_LONG : \
+     TMR_COUNTS(us, TMR_PRESCALER(TMR_TCKPS(timer, us))) < 2 ? TMR_ERR_SHORT : TMR_OK)
+#define TMR_SETUP_US(timer, us) \
+    ((void)sizeof(char[(TMR_ERROR(timer, us) == TMR_OK) ? 1 : -1]), \
+     hal_timer_config(timer, TMR_TCKPS(timer, us), TMR_PR(timer, us)))
+
+int tmr_setup_us(int timer, unsigned long us);
+
+// ADC related functions
+void ADCsetup();
+int getMeasurements(int flag);
+unsigned int adc_latest(AdcSample* out);
+int adc_lookup(const int* table, unsigned int code);
+extern const int adc_distance_lut[ADC_LUT_SIZE];
+extern const int adc_battery_lut[ADC_LUT_SIZE];
+extern FilterChain adc_filter[2];
+extern volatile AdcRing adcr;
+int adc_filtered(AdcSample* out);
+
+// Filter related functions
+void filter_init(FilterChain* c);
+int filter_config(FilterChain* c, int stage, int kind, int param);
+int filter_push(FilterChain* c, int x);
+int filter_average_dsp(const int* window, int n, int coef);
+int filter_average_ref(const int* window, int n, int coef);
+long filter_ema_dsp(long state, int x, int alpha);
+long filter_ema_ref(long state, int x, int alpha);
+int filter_median(const int* window, int n);
+int filter_median_slide(int* sorted, int n, int old, int x);
+
+// Motor related functions (motor.c)
+void PWMsetup(int PWM_freq);
+void PWMstop();
+void PWMstart(volatile ControlData* data);
+void motor_set(int left, int right);
+void motor_set_dead_time(int ms);
+int motor_dead_time(void);
+
+// Configuration related functions (config.c)
+#define CONFIG_HEADER  4
+#define CONFIG_PAYLOAD (8 + 4 + 2 + 24 + 2 * MAX_TASKS)
+#define CONFIG_RECORD  ((CONFIG_HEADER + CONFIG_PAYLOAD + 2 + HAL_FLASH_WORD - 1) / HAL_FLASH_WORD * HAL_FLASH_WORD)
+#define CONFIG_SLOTS   (HAL_FLASH_PAGE_SIZE / CONFIG_RECORD)  // Records per flash page
+extern int config_loaded;
+extern unsigned int config_seq;
+extern unsigned int config_saves;
+int config_load(void);
+int config_save(void);
+void config_capture(unsigned char* p);
+void config_apply(const unsigned char* p);
+void task_save_config(void* param);
+
+// Control related functions
+extern Pid pid_surge, pid_yaw;
+void control_law(volatile ControlData* data, int distance);
+void pid_init(Pid* p, int out_min, int out_max);
+void pid_gains(Pid* p, long kp, long ki, long kd, int period_ms);
+void pid_reset(Pid* p);
+int pid_step(Pid* p, int error, int input);
+void control_pid_init(void);
+void control_pid_reset(void);
+void control_pid_rate(int period_ms);
+void control_pid(volatile ControlData* data, int distance);
+void mix_q15(int surge, int yaw_rate, int* left, int* right);
+unsigned int q15_duty(int command, unsigned int period);
+
+// UART related functions
+void UARTsetup();
+int send_uart(const char* data);
+int send_uart_bytes(const char* data, unsigned int len);
+void isr_uart_tx(void);
+extern volatile TxQueue txq;
+extern int telemetry_mode;
+
+// Telemetry formatting functions
+void msg_begin(Message* m, const char* type);
+void msg_int(Message* m, int value);
+void msg_ulong(Message* m, unsigned long value);
+void msg_fixed(Message* m, int value, int decimals);
+void msg_str(Message* m, const char* text);
+int msg_end(Message* m);
+
+// Circular Buffer related functions
+int cb_push(volatile CircularBuffer *cb, char data);
+int cb_pop(volatile CircularBuffer *cb, char *data);
+int cb_pop_bulk(volatile CircularBuffer *cb, char *data, int max);
+unsigned int cb_pending(volatile CircularBuffer *cb);
+
+// Command related functions (commands.c)
+void commands_init(void);
+int command_apply(const parser_state* ps);
+void command_ack(const parser_state* ps, int reason);
+int command_dispatch(const parser_state* ps);
+
+// Timing related functions (perf.c)
+extern PerfStats perf[PERF_STAGES];
+extern unsigned long perf_start[PERF_STAGES];
+extern unsigned int perf_overruns;
+void perf_reset(void);
+void perf_record(PerfStage stage, unsigned long cycles);
+void task_send_perf(void* param);
+
+// Trace related functions (trace.c)
+extern TraceBuffer trace;
+void trace_start(unsigned long tick, int flags);
+void trace_stop(void);
+void trace_dump(void);
+void trace_loop(unsigned long tick, const AdcSample* sample, State state, State last);
+void trace_rx(unsigned long tick, const char* data, int n);
+void trace_service(void);
+
+// Parser related functions
+int parse_byte(parser_state* ps, char byte);
+void parser_init(parser_state* ps);
+int msg_field(const parser_state* ps, int k, int* value);
+
+// Scheduler related functions
+void scheduler_init(heartbeat schedInfo[], int nTasks);
+void scheduler(heartbeat schedInfo[], int nTasks, unsigned long tick);
+void scheduler_run(heartbeat schedInfo[], int nTasks);
+int scheduler_pending(void);
+void scheduler_set_period(heartbeat schedInfo[], int nTasks, int task, int N);
+void task_blinkA0 (void* param);
+void task_blink_indicators (void* param);
+void task_send_telemetry(void* param);
+
 #endif	
\ No newline at end of file
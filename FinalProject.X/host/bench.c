@@ -0,0 +1,1259 @@
+/*
+ * File:   bench.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Host micro-benchmarks of the firmware hot paths, built with 'make bench'.
+// Each benchmark runs its body for a fixed number of iterations and reports
+// the cost per operation in nanoseconds, operations per second and, on x86,
+// TSC cycles. The checks that follow report the accuracy and robustness of
+// the same paths. With -o both are also written as a JSON report, which
+// tools/bench_compare.py compares against a baseline report.
+//
+// Usage: bench [-n iterations] [-o report.json] [name...]
+
+#include "hal.h"
+#include "header.h"
+#include "telemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+typedef struct {
+    const char* name;
+    void (*run)(long iterations);
+} benchmark;
+
+static volatile int sink;  // Keeps the benchmarked results alive
+
+// Results collected for the JSON report
+#define MAX_RESULTS 64
+typedef struct {
+    const char* name;
+    double ns;          // Benchmarks: ns/op, checks: value
+    double cycles;
+    const char* unit;   // NULL for benchmarks
+} result;
+
+static result results[MAX_RESULTS];
+static int n_results;
+static int checks_failed;  // Checks that found failures: the run exits with 1
+
+static void report_check(const char* name, double value, const char* unit){
+    printf("%-30s %12.6g %14s\n", name, value, unit);
+    if (n_results < MAX_RESULTS)
+        results[n_results++] = (result){ name, value, 0, unit };
+}
+
+// A check whose value counts failures, any of them fails the run
+static void report_failures(const char* name, double count, const char* unit){
+    report_check(name, count, unit);
+    checks_failed += count != 0;
+}
+
+// Reference: the sprintf based formatting the firmware used before format.c
+static void bench_sprintf_battery(long n){
+    char buffer[32];
+    long k;
+    for (k = 0; k < n; k++) {
+        float battery = 7.0f + (k & 255) / 100.0f;
+        sink += sprintf(buffer, "$MBATT,%.2f*\n", battery);
+    }
+}
+
+static void bench_msg_battery(long n){
+    Message m;
+    long k;
+    for (k = 0; k < n; k++) {
+        float battery = 7.0f + (k & 255) / 100.0f;
+        msg_begin(&m, "MBATT");
+        msg_fixed(&m, (int)(battery * 100 + 0.5f), 2);
+        sink += msg_end(&m);
+    }
+}
+
+static void bench_sprintf_pwm(long n){
+    char buffer[32];
+    long k;
+    for (k = 0; k < n; k++) {
+        int dc = k % 101;
+        sink += sprintf(buffer, "$MPWM,%d,%d,%d,%d*\n", dc, 100 - dc, dc, 100 - dc);
+    }
+}
+
+static void bench_msg_pwm(long n){
+    Message m;
+    long k;
+    for (k = 0; k < n; k++) {
+        int dc = k % 101;
+        msg_begin(&m, "MPWM");
+        msg_int(&m, dc);
+        msg_int(&m, 100 - dc);
+        msg_int(&m, dc);
+        msg_int(&m, 100 - dc);
+        sink += msg_end(&m);
+    }
+}
+
+// Float reference of the control law and mixer (proportional normalization)
+static void control_float(ControlData* d, float distance, unsigned int period, unsigned int oc[4]){
+    if (distance < d->MINTH) {
+        d->surge = 0;
+        d->yaw_rate = 100;
+    } else if (distance > d->MAXTH) {
+        d->surge = 100;
+        d->yaw_rate = 0;
+    } else {
+        d->surge = distance * d->surge_gain;
+        d->yaw_rate = d->yaw_scale / distance;
+    }
+
+    float left_pwm = d->surge + d->yaw_rate;
+    float right_pwm = d->surge - d->yaw_rate;
+    float max_pwm = fmaxf(fabsf(left_pwm), fabsf(right_pwm));
+    if (max_pwm > 100) {
+        left_pwm *= 100 / max_pwm;
+        right_pwm *= 100 / max_pwm;
+    }
+    oc[0] = (left_pwm > 0) ? 0 : (-left_pwm / 100) * period;
+    oc[1] = (left_pwm > 0) ? left_pwm / 100 * period : 0;
+    oc[2] = (right_pwm > 0) ? 0 : (-right_pwm / 100) * period;
+    oc[3] = (right_pwm > 0) ? right_pwm / 100 * period : 0;
+}
+
+// Same path in integers, as run by the firmware (control_law + PWMstart)
+static void control_fixed(ControlData* d, int distance, unsigned int period, unsigned int oc[4]){
+    int left, right;
+    control_law(d, distance);
+    mix_q15(d->surge, d->yaw_rate, &left, &right);
+    oc[0] = (left > 0) ? 0 : q15_duty(-left, period);
+    oc[1] = (left > 0) ? q15_duty(left, period) : 0;
+    oc[2] = (right > 0) ? 0 : q15_duty(-right, period);
+    oc[3] = (right > 0) ? q15_duty(right, period) : 0;
+}
+
+static void bench_control_float(long n){
+    ControlData d = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+    unsigned int oc[4];
+    long k;
+    for (k = 0; k < n; k++) {
+        control_float(&d, 10.0f + (k & 1023) / 16.0f, FCY / 10000, oc);
+        sink += oc[0] + oc[1] + oc[2] + oc[3];
+    }
+}
+
+static void bench_control_q15(long n){
+    ControlData d = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+    unsigned int oc[4];
+    long k;
+    for (k = 0; k < n; k++) {
+        control_fixed(&d, 10 * DIST_ONE + (k & 1023), FCY / 10000, oc);
+        sink += oc[0] + oc[1] + oc[2] + oc[3];
+    }
+}
+
+// Largest OCxR difference between the float reference and the Q15 path, over
+// every distance from 0 to 150 cm (at the 1/16 cm resolution of the firmware)
+static void check_control_q15(void){
+    const unsigned int period = FCY / 10000;
+    unsigned int ref[4], out[4];
+    int distance, k, worst = 0;
+
+    for (distance = 0; distance <= 150 * DIST_ONE; distance++) {
+        ControlData a = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL}, b = a;
+        control_float(&a, (float)distance / DIST_ONE, period, ref);
+        control_fixed(&b, distance, period, out);
+        for (k = 0; k < 4; k++) {
+            int err = abs((int)ref[k] - (int)out[k]);
+            if (err > worst)
+                worst = err;
+        }
+    }
+    report_check("control/max_oc_error", worst, "counts");
+}
+
+// Float reference of pid_step with the same discretization, anti-windup and
+// derivative filter, errors in cm
+typedef struct {
+    double integ, deriv, prev;
+    int started;
+} pid_float;
+
+static double pid_float_step(pid_float* f, const Pid* p, double error, double input){
+    double T = p->period_ms / 1000.0;
+    double kp = (double)p->kp / (1 << PID_GAIN_BITS);
+    double ki = (double)p->ki / (1 << PID_GAIN_BITS);
+    double kd = (double)p->kd / (1 << PID_GAIN_BITS);
+    double out;
+
+    if (f->started) {
+        double delta = fmax(fmin(f->prev - input, (double)PID_MAX_DELTA / DIST_ONE), -(double)PID_MAX_DELTA / DIST_ONE);
+        f->deriv += (kd / T * delta - f->deriv) / (1 << PID_D_SHIFT);
+    }
+    f->prev = input;
+    f->started = 1;
+    out = kp * error + f->integ + f->deriv;
+    if (!(out >= p->out_max && error > 0) && !(out <= p->out_min && error < 0)) {
+        f->integ = fmax(fmin(f->integ + ki * T * error, p->out_max), p->out_min);
+        out = kp * error + f->integ + f->deriv;
+    }
+    return fmax(fmin(out, p->out_max), p->out_min);
+}
+
+// Largest output difference between pid_step and the float reference over a
+// measurement that sweeps both saturations and crosses the setpoint many
+// times, with setpoint steps
+static void check_pid(void){
+    Pid p;
+    pid_float f = {0, 0, 0, 0};
+    double worst = 0;
+    long k;
+
+    pid_init(&p, 0, 100);
+    pid_gains(&p, PID_GAIN_Q8(600), PID_GAIN_Q8(20), PID_GAIN_Q8(40), PID_PERIOD_MS);
+    for (k = 0; k < 20000; k++) {
+        int input = (int)(40 * DIST_ONE * sin(k / 300.0)) + (int)(k % 7) - 3;
+        int error = ((k / 2000) % 2) * 5 * DIST_ONE - input;
+        double ref = pid_float_step(&f, &p, (double)error / DIST_ONE, (double)input / DIST_ONE);
+        double err = fabs(pid_step(&p, error, input) - ref);
+        if (err > worst)
+            worst = err;
+    }
+    report_check("pid/max_output_error", worst, "%");
+}
+
+static void bench_pid_step(long n){
+    Pid p;
+    long k;
+    pid_init(&p, 0, 100);
+    pid_gains(&p, PID_GAIN_Q8(600), PID_GAIN_Q8(20), PID_GAIN_Q8(40), PID_PERIOD_MS);
+    for (k = 0; k < n; k++)
+        sink += pid_step(&p, (int)(k & 1023) - 512, 512 - (int)(k & 1023));
+}
+
+// Float reference of the ADC conversions (what getMeasurements used to evaluate)
+static float distance_poly(unsigned int code){
+    float V = code * 3.3/1024.0;
+    return 100 * (2.34 - 4.74 * V + 4.06 * powf(V,2) - 1.60 * powf(V,3) + 0.24 * powf(V,4));
+}
+
+static float battery_divider(unsigned int code){
+    float V = code * 3.3/1024.0;
+    return V * (100.0 + 100.0 + 100.0) / 100.0;
+}
+
+static void bench_adc_poly(long n){
+    long k;
+    for (k = 0; k < n; k++)
+        sink += (int)distance_poly(k & 1023);
+}
+
+static void bench_adc_lut(long n){
+    long k;
+    for (k = 0; k < n; k++)
+        sink += adc_lookup(adc_distance_lut, k & 1023);
+}
+
+// Largest table error over the 1024 ADC codes, in cm and in volts
+static void check_adc_lut(void){
+    float dist_err = 0, batt_err = 0;
+    unsigned int code;
+
+    for (code = 0; code < 1024; code++) {
+        float d = fabsf(distance_poly(code) - (float)adc_lookup(adc_distance_lut, code) / DIST_ONE);
+        float b = fabsf(battery_divider(code) - adc_lookup(adc_battery_lut, code) / 100.0f);
+        if (d > dist_err)
+            dist_err = d;
+        if (b > batt_err)
+            batt_err = b;
+    }
+    report_check("adc/max_distance_error", dist_err, "cm");
+    report_check("adc/max_battery_error", batt_err, "V");
+}
+
+// Inputs of the filter benchmarks: IR codes around 400 with +-32 of noise
+static int filter_input(long k){
+    return 400 + (int)((k * 2654435761UL) >> 26) - 32;
+}
+
+static void bench_average_dsp(long n){
+    int window[8];
+    long k;
+    for (k = 0; k < 8; k++)
+        window[k] = filter_input(k);
+    for (k = 0; k < n; k++) {
+        window[k & 7] = filter_input(k);
+        sink += filter_average_dsp(window, 8, 4096);
+    }
+}
+
+static void bench_average_ref(long n){
+    int window[8];
+    long k;
+    for (k = 0; k < 8; k++)
+        window[k] = filter_input(k);
+    for (k = 0; k < n; k++) {
+        window[k & 7] = filter_input(k);
+        sink += filter_average_ref(window, 8, 4096);
+    }
+}
+
+static void bench_median5(long n){
+    int window[5] = {400, 400, 400, 400, 400};
+    long k;
+    for (k = 0; k < n; k++) {
+        window[k % 5] = filter_input(k);
+        sink += filter_median(window, 5);
+    }
+}
+
+static void bench_median5_slide(long n){
+    int window[5] = {400, 400, 400, 400, 400}, sorted[5] = {400, 400, 400, 400, 400};
+    long k;
+    for (k = 0; k < n; k++) {
+        int old = window[k % 5];
+        window[k % 5] = filter_input(k);
+        sink += filter_median_slide(sorted, 5, old, window[k % 5]);
+    }
+}
+
+static void bench_ema_dsp(long n){
+    long state = 400L << FILTER_EMA_BITS;
+    long k;
+    for (k = 0; k < n; k++)
+        state = filter_ema_dsp(state, filter_input(k), 2048);
+    sink += state;
+}
+
+static void bench_ema_ref(long n){
+    long state = 400L << FILTER_EMA_BITS;
+    long k;
+    for (k = 0; k < n; k++)
+        state = filter_ema_ref(state, filter_input(k), 2048);
+    sink += state;
+}
+
+// One sample through the IR chain set up by ADCsetup (median of 5, mean of 8)
+static void bench_filter_chain(long n){
+    FilterChain c;
+    long k;
+    filter_init(&c);
+    filter_config(&c, 0, FILTER_MEDIAN, 5);
+    filter_config(&c, 1, FILTER_AVERAGE, 8);
+    for (k = 0; k < n; k++)
+        sink += filter_push(&c, filter_input(k));
+}
+
+// DSP and portable versions of the average and of the EMA must agree to the
+// bit, on random windows of every length and on random EMA steps; the average
+// is also compared with the exact mean. An EMA fed a step, small ones
+// included, settles within a code of it whatever alpha is
+static void check_filters(void){
+    static const int alphas[] = {1, 64, 2048, 32767};
+    static const int steps[][2] = {{500, 507}, {507, 500}, {500, 501}, {0, 1023}, {1023, 0}};
+    int window[FILTER_MAX_N];
+    int diff = 0, unsettled = 0, n, k, trial;
+    double mean_err = 0;
+
+    srand(3);
+    for (trial = 0; trial < 20000; trial++) {
+        FilterStage s;
+        FilterChain c;
+        n = 1 + trial % FILTER_MAX_N;
+        filter_init(&c);
+        filter_config(&c, 0, FILTER_AVERAGE, n);
+        s = c.stage[0];
+        double exact = 0;
+        for (k = 0; k < n; k++) {
+            window[k] = rand() & 0x3FF;
+            exact += window[k];
+        }
+        exact /= n;
+        int dsp = filter_average_dsp(window, n, s.coef);
+        diff += dsp != filter_average_ref(window, n, s.coef);
+        if (fabs(dsp - exact) > mean_err)
+            mean_err = fabs(dsp - exact);
+
+        long state = rand() % (1024L << FILTER_EMA_BITS);
+        int x = rand() & 0x3FF, alpha = 1 + rand() % 32767;
+        diff += filter_ema_dsp(state, x, alpha) != filter_ema_ref(state, x, alpha);
+    }
+
+    // The sliding median of the chains against a sort of the whole window
+    for (n = 1; n <= FILTER_MAX_N; n++) {
+        FilterChain c;
+        filter_init(&c);
+        filter_config(&c, 0, FILTER_MEDIAN, n);
+        for (trial = 0; trial < 2000; trial++) {
+            int x = (trial % 3) ? rand() & 0x3FF : 512;  // Repeated values too
+            int out = filter_push(&c, x);
+            diff += out != filter_median(c.stage[0].window, n);
+        }
+    }
+
+    for (n = 0; n < (int)(sizeof(alphas) / sizeof(alphas[0])); n++) {
+        for (k = 0; k < (int)(sizeof(steps) / sizeof(steps[0])); k++) {
+            FilterChain c;
+            int out = 0;
+            filter_init(&c);
+            filter_config(&c, 0, FILTER_EMA, alphas[n]);
+            filter_push(&c, steps[k][0]);
+            // 12 time constants
+            for (trial = 0; trial < 12 * 32768L / alphas[n] + 1; trial++)
+                out = filter_push(&c, steps[k][1]);
+            unsettled += abs(out - steps[k][1]) > 1;
+        }
+    }
+    report_failures("filter/dsp_ref_mismatches", diff, "cases");
+    report_failures("filter/ema_unsettled_steps", unsettled, "cases");
+    report_check("filter/max_average_error", mean_err, "codes");
+}
+
+static void bench_cb_push_pop(long n){
+    static volatile CircularBuffer rx;
+    char c;
+    long k;
+    for (k = 0; k < n; k++) {
+        cb_push(&rx, (char)k);
+        cb_pop(&rx, &c);
+        sink += c;
+    }
+}
+
+// Stress of the RX ring: a thread stands in for the U2RX interrupt and pushes
+// a counting sequence as fast as it can, retrying a byte when the ring is
+// full (as the hardware FIFO would hold it); the consumer pops in bulk and
+// checks that nothing is lost, duplicated or reordered
+#define STRESS_BYTES 2000000L
+
+static volatile CircularBuffer stress_cb;
+static long stress_retries;
+
+static void* stress_producer(void* arg){
+    long k;
+    (void)arg;
+    for (k = 0; k < STRESS_BYTES; k++) {
+        while (!cb_push(&stress_cb, (char)k)) {
+            stress_retries++;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void check_cb_stress(void){
+    pthread_t producer;
+    char chunk[8];
+    long received = 0, errors = 0;
+
+    memset((void*)&stress_cb, 0, sizeof(stress_cb));
+    stress_retries = 0;
+    pthread_create(&producer, NULL, stress_producer, NULL);
+    while (received < STRESS_BYTES) {
+        int n = cb_pop_bulk(&stress_cb, chunk, sizeof(chunk)), k;
+        if (n == 0)
+            sched_yield();
+        for (k = 0; k < n; k++, received++) {
+            if (chunk[k] != (char)received)
+                errors++;
+        }
+    }
+    pthread_join(producer, NULL);
+
+    report_failures("rx/stress_errors", errors, "bytes");
+    report_check("rx/stress_drop_accounting", stress_cb.dropped == (unsigned int)stress_retries, "ok");
+    checks_failed += stress_cb.dropped != (unsigned int)stress_retries;
+    report_check("rx/stress_high_water", stress_cb.high_water, "bytes");
+}
+
+static void bench_parse_pcth(long n){
+    static const char command[] = "$PCTH,25,50*";
+    parser_state ps;
+    int value;
+    long k;
+    unsigned int c;
+    parser_init(&ps);
+    for (k = 0; k < n; k++) {
+        for (c = 0; c < sizeof(command) - 1; c++) {
+            if (parse_byte(&ps, command[c]) == NEW_MESSAGE && msg_field(&ps, 1, &value))
+                sink += value;
+        }
+    }
+}
+
+// Parse a whole message and compare its fields with the expected ones
+// (expect_valid bit k set if field k must be valid)
+static int parse_case(const char* text, int n_fields, unsigned int expect_valid, const int* expect){
+    parser_state ps;
+    int k, value, ok = 0;
+    parser_init(&ps);
+    while (*text != '\0') {
+        if (parse_byte(&ps, *text++) == NEW_MESSAGE)
+            ok = 1;
+    }
+    if (!ok || ps.n_fields != n_fields)
+        return 0;
+    for (k = 0; k < MSG_MAX_FIELDS; k++) {
+        int valid = msg_field(&ps, k, &value);
+        if (valid != ((expect_valid >> k) & 1) || (valid && value != expect[k]))
+            return 0;
+    }
+    return 1;
+}
+
+// Payload tokenizer: well formed, malformed and out of range fields, and two
+// commands in a row (the second used to be read at a stale offset)
+static void check_parser(void){
+    static const int pcth[] = {25, 50}, signs[] = {-7, 3, 0, INT_MIN};
+    static const int bad[] = {0, 12, 0, 0}, empty[] = {0};
+    static const int range[] = {INT_MAX, 0};
+    char text[64];
+    int failed = 0;
+
+    failed += !parse_case("$PCTH,25,50*", 2, 0x3, pcth);
+    failed += !parse_case("garbage$PCTH,25,50*$PCTH,25,50*", 2, 0x3, pcth);
+    failed += !parse_case("$PCTH*", 0, 0x0, empty);
+    failed += !parse_case("$PCTH,,12,1a,+-3*", 4, 0x2, bad);
+    failed += !parse_case("$PCTH,1,2,3,4,5*", 5, 0xF, (const int[]){1, 2, 3, 4});
+    snprintf(text, sizeof(text), "$PCTH,-7,+3,0,%d*", INT_MIN);
+    failed += !parse_case(text, 4, 0xF, signs);
+    snprintf(text, sizeof(text), "$PCTH,%d,%u*", INT_MAX, (unsigned int)INT_MAX + 1);
+    failed += !parse_case(text, 2, 0x1, range);
+    failed += parse_case("$TOOLONG,1*", 1, 0x1, (const int[]){1});
+    report_failures("parse/failed_cases", failed, "cases");
+}
+
+static void task_count(void* param){
+    sink += (int)(long)param;
+}
+
+// One scheduler release and run per tick with MAX_TASKS tasks, staggered as in main.c
+static void bench_scheduler(long n){
+    heartbeat tasks[MAX_TASKS];
+    long k;
+    for (k = 0; k < MAX_TASKS; k++)
+        tasks[k] = (heartbeat){ .N = 10, .phase = k, .f = task_count, .params = (void*)k, .enable = 1 };
+    scheduler_init(tasks, MAX_TASKS);
+    for (k = 0; k < n; k++) {
+        scheduler(tasks, MAX_TASKS, k);
+        scheduler_run(tasks, MAX_TASKS);
+    }
+}
+
+// Reference: the counter scan scheduler the firmware used before absolute
+// release times, every task is visited on every tick
+typedef struct {
+    int n;
+    int N;
+    void (*f)(void *);
+    void* params;
+} counter_task;
+
+static void scheduler_counter_scan(counter_task tasks[], int nTasks){
+    int i;
+    for (i = 0; i < nTasks; i++) {
+        tasks[i].n++;
+        if (tasks[i].n >= tasks[i].N) {
+            tasks[i].f(tasks[i].params);
+            tasks[i].n = 0;
+        }
+    }
+}
+
+// Periods of the SCHED_MAX_TASKS tasks of the many task benchmarks (ticks)
+static int many_period(int k){
+    static const int periods[] = { 10, 100, 250, 1000, 10000 };
+    return periods[k % 5];
+}
+
+static void bench_scheduler_many(long n){
+    heartbeat tasks[SCHED_MAX_TASKS];
+    long k;
+    for (k = 0; k < SCHED_MAX_TASKS; k++)
+        tasks[k] = (heartbeat){ .N = many_period(k), .phase = k, .f = task_count, .params = (void*)k, .enable = 1 };
+    scheduler_init(tasks, SCHED_MAX_TASKS);
+    for (k = 0; k < n; k++) {
+        scheduler(tasks, SCHED_MAX_TASKS, k);
+        scheduler_run(tasks, SCHED_MAX_TASKS);
+    }
+}
+
+static void bench_scheduler_many_reference(long n){
+    counter_task tasks[SCHED_MAX_TASKS];
+    long k;
+    for (k = 0; k < SCHED_MAX_TASKS; k++)
+        tasks[k] = (counter_task){ .n = 0, .N = many_period(k), .f = task_count, .params = (void*)k };
+    for (k = 0; k < n; k++)
+        scheduler_counter_scan(tasks, SCHED_MAX_TASKS);
+}
+
+// Feed a stream to a parser, counting the messages completed
+static int parse_stream(parser_state* ps, const char* text, int len){
+    int k, messages = 0;
+    for (k = 0; k < len; k++)
+        messages += parse_byte(ps, text[k]) == NEW_MESSAGE;
+    return messages;
+}
+
+// Line noise between frames: '*' and ',' outside a frame and a '$' that
+// starts a type which never ends, before every well formed command
+static void bench_parse_garbage(long n){
+    static const char stream[] = "\x7f*,,12*x\xff\x01$TOOLONGTYPE,1*~~~~,*\r\n0123456789abcdef**$PCTH,25,50*";
+    parser_state ps;
+    long k;
+    parser_init(&ps);
+    for (k = 0; k < n; k++)
+        sink += parse_stream(&ps, stream, sizeof(stream) - 1);
+}
+
+// Payload just under the 100 chars limit: many fields, out of int range
+// values and malformed ones
+static void bench_parse_long_payload(long n){
+    static const char stream[] =
+        "$PCTH,12345,-32768,99999999999,+17,1a2b,,-,00000000000000000001,"
+        "7,8,9,10,11,12,13,14,15,16,17,18,19,2*";
+    parser_state ps;
+    long k;
+    parser_init(&ps);
+    for (k = 0; k < n; k++)
+        sink += parse_stream(&ps, stream, sizeof(stream) - 1);
+}
+
+// Payload over the limit: dropped by the parser
+static void bench_parse_overflow(long n){
+    static char stream[160];
+    parser_state ps;
+    long k;
+    if (stream[0] == '\0') {
+        memset(stream, '9', sizeof(stream) - 1);
+        memcpy(stream, "$PCTH,", 6);
+        stream[sizeof(stream) - 2] = '*';
+    }
+    parser_init(&ps);
+    for (k = 0; k < n; k++)
+        sink += parse_stream(&ps, stream, sizeof(stream) - 1);
+}
+
+// ADC interrupt publishing a sample and the loop reading both conversions,
+// codes sweeping the full 10 bit range
+static void bench_get_measurements(long n){
+    long k;
+    for (k = 0; k < n; k++) {
+        isr_adc((k * 7) & 1023, k & 1023);
+        sink += getMeasurements(DISTANCE) + getMeasurements(BATTERY);
+    }
+}
+
+// Mixer and OCxR update for surge and yaw rate sweeping the Moving range
+static void bench_pwm_start(long n){
+    static volatile ControlData d = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+    long k;
+    for (k = 0; k < n; k++) {
+        d.surge = k % 101;
+        d.yaw_rate = 100 - (k % 201);
+        PWMstart(&d);
+        sink += HAL_OC2R + HAL_OC4R;
+    }
+}
+
+// Same, with surge and yaw rate unchanged: no register is written
+static void bench_pwm_unchanged(long n){
+    static volatile ControlData d = {25, 50, 60, -20, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+    long k;
+    for (k = 0; k < n; k++) {
+        PWMstart(&d);
+        sink += HAL_OC2R + HAL_OC4R;
+    }
+}
+
+// Boot-time configuration load with records in both pages: reads all the
+// headers and the newest record
+static void bench_config_load(long n){
+    static unsigned char image[sizeof(sim.flash)];
+    long k;
+
+    memcpy(image, sim.flash, sizeof(image));
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    for (k = 0; k < 100; k++)
+        config_save();
+    for (k = 0; k < n; k++)
+        sink += config_load();
+    memcpy(sim.flash, image, sizeof(image));
+    config_load();
+}
+
+static void bench_cb_bulk(long n){
+    static volatile CircularBuffer rx;
+    char chunk[RX_CHUNK];
+    long k;
+    int c;
+    for (k = 0; k < n; k++) {
+        for (c = 0; c < 12; c++)
+            cb_push(&rx, (char)c);
+        sink += cb_pop_bulk(&rx, chunk, sizeof(chunk));
+    }
+}
+
+// Feed a message to the dispatcher, returns what command_dispatch returned
+static int dispatch(const char* text){
+    parser_state ps;
+    int applied = -1;
+    parser_init(&ps);
+    while (*text != '\0') {
+        if (parse_byte(&ps, *text++) == NEW_MESSAGE)
+            applied = command_dispatch(&ps);
+    }
+    return applied;
+}
+
+static void bench_dispatch(long n){
+    static const char* const messages[] = { "$PCTH,25,50*", "$PGAIN,2,500*", "$PXXX,1*" };
+    long k;
+    for (k = 0; k < n; k++) {
+        sink += dispatch(messages[k % 3]);
+        txq.tail = txq.head;  // Discard the acknowledgements
+    }
+}
+
+// Commands applied or rejected as their schema says
+static void check_dispatch(void){
+    int failed = 0;
+
+    failed += dispatch("$PCTH,20,40*") != 1 || control_data.MINTH != 20 || control_data.MAXTH != 40;
+    failed += dispatch("$PCTH,40,20*") != 0 || control_data.MINTH != 20;
+    failed += dispatch("$PCTH,20,400*") != 0 || control_data.MAXTH != 40;
+    failed += dispatch("$PCTH,20*") != 0;
+    failed += dispatch("$PCTH,20,x*") != 0;
+    failed += dispatch("$PSTT,1*") != 1 || control_data.state != Moving;
+    failed += dispatch("$PSTT,0*") != 1 || control_data.state != WaitForStart;
+    failed += dispatch("$PGAIN,3,400*") != 1 || control_data.surge_gain != 3 || control_data.yaw_scale != 400;
+    failed += dispatch("$PRATE,2,100*") != 1 || schedInfo[2].N != 100;
+    failed += dispatch("$PRATE,2,1000*") != 1 || schedInfo[2].N != 1000;
+    failed += dispatch("$PRATE,2,0*") != 0 || dispatch("$PRATE,9,100*") != 0;
+    failed += dispatch("$PTEN,3,0*") != 1 || schedInfo[3].enable != 0;
+    failed += dispatch("$PTEN,3,1*") != 1 || schedInfo[3].enable != 1;
+    failed += dispatch("$PTEN,3,2*") != 0;
+    failed += dispatch("$PPID,1,250,10,5*") != 1 || pid_yaw.kp != PID_GAIN_Q8(250) || pid_yaw.kd != PID_GAIN_Q8(5);
+    failed += dispatch("$PPID,2,250,10,5*") != 0 || dispatch("$PPID,0,250,10*") != 0;
+    failed += dispatch("$PPIDR,20*") != 1 || pid_surge.period_ms != 20 || pid_yaw.period_ms != 20;
+    failed += dispatch("$PPIDR,0*") != 0;
+    failed += dispatch("$PLAW,0*") != 1 || control_data.law != LAW_PROPORTIONAL;
+    failed += dispatch("$PLAW,1*") != 1 || control_data.law != LAW_PID;
+    failed += dispatch("$PLAW,2*") != 0;
+    failed += dispatch("$PFLT,1,2,3,4096*") != 1 || adc_filter[ADC_IR].stage[2].kind != FILTER_EMA;
+    failed += dispatch("$PFLT,1,2,0,0*") != 1 || adc_filter[ADC_IR].stage[2].kind != FILTER_NONE;
+    failed += dispatch("$PFLT,1,0,1,17*") != 0 || dispatch("$PFLT,1,3,1,4*") != 0 || dispatch("$PFLT,0,0,3,0*") != 0;
+    failed += dispatch("$PTRC,1*") != 1 || trace.mode != TRACE_RECORD || trace.len != TRACE_HEADER_LEN + 1 + CONFIG_PAYLOAD;
+    failed += dispatch("$PTRC,0*") != 1 || trace.mode != TRACE_OFF;
+    failed += dispatch("$PTRC,3*") != 0;
+    perf[PERF_LOOP].hist[0] = 0xFFFF;
+    perf_overruns = 3;
+    failed += dispatch("$PPRF*") != 1 || perf[PERF_LOOP].hist[0] != 0 || perf_overruns != 0;
+    failed += dispatch("$PPRF,1*") != 0;
+    failed += dispatch("$PCTHX,1,2*") != 0;
+    failed += dispatch("$pcth,1,2*") != 0;
+    failed += dispatch("$PCT,1,2*") != 0;
+    report_failures("cmd/failed_cases", failed, "cases");
+
+    control_data.MINTH = 25;
+    control_data.MAXTH = 50;
+    control_data.surge_gain = SURGE_GAIN;
+    control_data.yaw_scale = YAW_SCALE;
+    control_pid_init();
+    txq.tail = txq.head;
+}
+
+static void bench_tlm_frame(long n){
+    unsigned char rec[TLM_MAX_RECORD], frame[TLM_MAX_FRAME];
+    const unsigned char duty[4] = {0, 100, 37, 0};
+    long k;
+    for (k = 0; k < n; k++)
+        sink += tlm_frame(rec, tlm_record_snapshot(rec, 600 + (k & 255), 753, 75, -13, duty, k & 1), frame);
+}
+
+static void bench_telemetry_ascii(long n){
+    long k;
+    telemetry_mode = TELEMETRY_ASCII;
+    for (k = 0; k < n; k++) {
+        task_send_telemetry(NULL);
+        txq.tail = txq.head;  // Discard the message
+    }
+}
+
+static void bench_telemetry_binary(long n){
+    long k;
+    telemetry_mode = TELEMETRY_BINARY;
+    for (k = 0; k < n; k++) {
+        task_send_telemetry(NULL);
+        txq.tail = txq.head;
+    }
+    telemetry_mode = TELEMETRY_ASCII;
+}
+
+// A round of the $MPERF task with every field at its widest on the dsPIC
+// (32 bit long): all the messages fit in a Message and reach the transmit queue
+static void check_perf_messages(void){
+    unsigned int k, lines = 0;
+    int s;
+
+    txq.tail = txq.head;
+    for (s = 0; s < PERF_STAGES; s++) {
+        perf[s].min = perf[s].max = 0xFFFFFFFFUL;
+        for (k = 0; k < PERF_BINS; k++)
+            perf[s].hist[k] = 0xFFFF;
+    }
+    perf_overruns = UINT_MAX;
+    for (s = 0; s <= PERF_STAGES; s++) {
+        task_send_perf(NULL);
+        for (k = txq.tail; k != txq.head; k++)
+            lines += txq.buffer[k & (TX_BUFFER_SIZE - 1)] == '\n';
+        txq.tail = txq.head;
+    }
+    perf_reset();
+    report_failures("perf/lost_messages", PERF_STAGES + 1 - lines, "messages");
+}
+
+// CRC-16/CCITT-FALSE check value and COBS round trips of data with runs of
+// zeros and of non-zero bytes around the 254 byte block length
+static void check_tlm_codec(void){
+    static unsigned char in[600], enc[620], dec[620];
+    int failed = 0, len, k, seed;
+
+    failed += tlm_crc16((const unsigned char*)"123456789", 9) != 0x29B1;
+    for (seed = 0; seed < 4; seed++) {
+        for (len = 0; len <= 520; len++) {
+            for (k = 0; k < len; k++)
+                in[k] = (seed == 0) ? 0 : (seed == 1) ? 1 + k % 255 : (seed == 2) ? (k % 7 ? k : 0) : rand();
+            int n = tlm_cobs_encode(in, len, enc);
+            int bad = memchr(enc, 0, n) != NULL || n > len + 1 + len / 254;
+            bad |= tlm_cobs_decode(enc, n, dec) != len || memcmp(in, dec, len) != 0;
+            failed += bad;
+        }
+    }
+    report_failures("tlm/failed_cases", failed, "cases");
+}
+
+// Motor outputs over random commands held for a few periods, with stops: no
+// write leaves both channels of a wheel on, a wheel only reverses after the
+// dead time off, and exactly the compare values that change are written
+static void check_motor(void){
+    ControlData d = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+    const int dead = LOOP_TICKS_MS(MOTOR_DEAD_TIME_MS);
+    unsigned int prev[4] = {0, 0, 0, 0};
+    unsigned long overlaps, writes, changes = 0, reversals = 0;
+    int off[2] = {255, 255}, dir[2] = {0, 0}, failed = 0, k, w;
+    long n;
+
+    PWMsetup(10000);
+    overlaps = sim.oc_overlaps;
+    writes = sim.oc_writes;
+    srand(1);
+    for (n = 0; n < 100000; n++) {
+        if (rand() % 8 == 0) {
+            d.surge = rand() % 201 - 100;
+            d.yaw_rate = rand() % 201 - 100;
+        }
+        if (rand() % 16 == 0)
+            PWMstop();
+        else
+            PWMstart(&d);
+        for (k = 0; k < 4; k++)
+            changes += sim.oc_r[k] != prev[k];
+        for (w = 0; w < 2; w++) {
+            int ccw = sim.oc_r[2 * w], cw = sim.oc_r[2 * w + 1];
+            int now = cw ? 1 : ccw ? -1 : 0;
+            if (now != 0 && now == -dir[w]) {
+                failed += off[w] < dead;
+                reversals++;
+            }
+            if (now != 0) {
+                dir[w] = now;
+                off[w] = 0;
+            } else if (off[w] < 255) {
+                off[w]++;
+            }
+        }
+        memcpy(prev, (const void*)sim.oc_r, sizeof(prev));
+    }
+    failed += sim.oc_overlaps != overlaps || reversals == 0;
+    failed += sim.oc_writes - writes != changes;
+    report_failures("motor/failed_cases", failed, "cases");
+    report_check("motor/writes_per_period", (double)changes / n, "writes");
+}
+
+// One timer period against an exhaustive search: the smallest prescaler whose
+// rounded count fits, or TMR_ERR_LONG, and the simulated timer running the
+// requested period within half a prescaler step
+static int timer_case(int timer, unsigned long us){
+    static const int presc[4] = {1, 8, 64, 256};
+    unsigned long long cycles = (unsigned long long)us * (FCY / 1000000);
+    unsigned long long max = (timer >= TIMER23) ? 1ULL << 32 : 1ULL << 16;
+    unsigned long long got;
+    int k, error = tmr_setup_us(timer, us);
+    sim_timer* t = &sim.timer[timer];
+
+    for (k = 0; k < 4 && (cycles + presc[k] / 2) / presc[k] > max; k++)
+        ;
+    if (k == 4)
+        return error != TMR_ERR_LONG;
+    if (error != TMR_OK || t->tckps != k)
+        return 1;
+    got = (unsigned long long)(t->period + 1) * presc[k];
+    return (got > cycles ? got - cycles : cycles - got) > (unsigned long long)presc[k] / 2;
+}
+
+// Prescaler selection of the timer API, at the prescaler boundaries and over
+// the range of each timer, and its errors
+static void check_timer(void){
+    static const unsigned long presc[4] = {1, 8, 64, 256};
+    enum { PR_5KHZ = TMR_PR(TIMER1, 200), TCKPS_1KHZ = TMR_TCKPS(TIMER1, 1000) };  // Compile time
+    sim_timer saved[8];
+    int failed = 0, timer, k, d;
+    unsigned long us;
+
+    memcpy(saved, sim.timer, sizeof(saved));
+    for (timer = TIMER1; timer <= TIMER45; timer++) {
+        for (us = 1; us < 20000000; us += (us < 1000) ? 1 : us / 997)
+            failed += timer_case(timer, us);
+        for (k = 0; k < 4; k++) {
+            unsigned long long limit = ((timer >= TIMER23) ? 1ULL << 32 : 1ULL << 16) * presc[k] / (FCY / 1000000);
+            for (d = -1; d <= 2 && limit + d <= 0xFFFFFFFFUL; d++)
+                failed += timer_case(timer, limit + d);
+        }
+    }
+    failed += PR_5KHZ != 14399 || TCKPS_1KHZ != 1;
+    failed += tmr_setup_us(0, 1000) != TMR_ERR_TIMER;
+    failed += tmr_setup_us(TIMER45 + 1, 1000) != TMR_ERR_TIMER;
+    failed += tmr_setup_us(TIMER1, 0) != TMR_ERR_SHORT;
+    failed += tmr_setup_us(TIMER1, 233018) != TMR_OK;        // 65536 counts of 256 cycles, rounded
+    failed += tmr_setup_us(TIMER1, 233019) != TMR_ERR_LONG;
+    failed += tmr_setup_us(TIMER23, 233019) != TMR_OK;
+    memcpy(sim.timer, saved, sizeof(saved));
+    report_failures("timer/failed_cases", failed, "cases");
+}
+
+// Configuration store over the emulated flash, after a power loss: set, then
+// read back from a reboot (-1 for the defaults, -2 for a mixed record)
+static void config_set(int v){
+    control_data.MINTH = v;
+    control_data.MAXTH = v + 50;
+    pid_gains(&pid_surge, PID_GAIN_Q8(v), pid_surge.ki, pid_surge.kd, pid_surge.period_ms);
+    scheduler_set_period(schedInfo, MAX_TASKS, 2, LOOP_TICKS_MS(100 + v));
+}
+
+static int config_reboot(void){
+    control_data.MINTH = 0;
+    control_data.MAXTH = 0;
+    if (!config_load())
+        return -1;
+    if (control_data.MAXTH != control_data.MINTH + 50 || pid_surge.kp != PID_GAIN_Q8(control_data.MINTH)
+        || schedInfo[2].N != LOOP_TICKS_MS(100 + control_data.MINTH))
+        return -2;
+    return control_data.MINTH;
+}
+
+// Saves over both pages load back; a power loss at any flash operation of a
+// save leaves the previous or the new record and the next save recovers; a
+// record with a bad CRC falls back to the previous one; sequence numbers wrap;
+// a configuration loaded at boot keeps the task phases of a boot without one
+static void check_config(void){
+    static unsigned char image[sizeof(sim.flash)];
+    ControlData data = control_data;
+    Pid surge = pid_surge, yaw = pid_yaw;
+    heartbeat tasks[MAX_TASKS];
+    unsigned long ops, next[MAX_TASKS];
+    unsigned int seq;
+    int failed = 0, s, k, v, old;
+
+    memcpy(tasks, schedInfo, sizeof(tasks));
+    scheduler_init(schedInfo, MAX_TASKS);
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    failed += config_reboot() != -1;
+    for (k = 0; k < MAX_TASKS; k++)
+        next[k] = schedInfo[k].next;
+    for (s = 1; s <= 100; s++) {
+        old = (s == 1) ? -1 : s - 1;
+        memcpy(image, sim.flash, sizeof(image));
+        ops = sim.flash_ops;
+        config_set(s);
+        failed += config_save() != 0;
+        ops = sim.flash_ops - ops;
+        for (k = 1; k <= (int)ops; k++) {
+            memcpy(sim.flash, image, sizeof(image));
+            failed += config_reboot() != old;
+            config_set(s);
+            sim.flash_cut_at = sim.flash_ops + k;
+            config_save();
+            sim.flash_cut_at = 0;
+            v = config_reboot();
+            failed += v != old && v != s;
+            config_set(s + 1);
+            failed += config_save() != 0 || config_reboot() != s + 1;
+        }
+        memcpy(sim.flash, image, sizeof(image));
+        config_reboot();
+        config_set(s);
+        failed += config_save() != 0 || config_reboot() != s;
+    }
+    for (k = 0; k < HAL_FLASH_PAGES * HAL_FLASH_PAGE_SIZE; k += HAL_FLASH_WORD) {
+        unsigned char* r = &sim.flash[0][0] + k;
+        if (r[0] == 0xC5 && r[1] == 1 && (r[2] | r[3] << 8) == config_seq)
+            r[6] = 0;  // MAXTH, programming clears bits
+    }
+    failed += config_reboot() != 99;
+    seq = config_seq;
+    for (k = 0; k < 70000; k++) {
+        config_set(1 + k % 100);
+        failed += config_save() != 0;
+    }
+    failed += config_reboot() != 1 + (k - 1) % 100 || config_seq != (seq + 70000) % 65536;
+    scheduler_init(schedInfo, MAX_TASKS);
+    failed += config_reboot() < 0;
+    for (k = 0; k < MAX_TASKS; k++)
+        failed += schedInfo[k].next != next[k];
+    failed += sim.flash_errors != 0;
+
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    config_load();
+    control_data = data;
+    pid_surge = surge;
+    pid_yaw = yaw;
+    memcpy(schedInfo, tasks, sizeof(tasks));
+    scheduler_init(schedInfo, MAX_TASKS);
+    report_failures("config/failed_cases", failed, "cases");
+}
+
+// Commands received at 9600 baud while the configuration changes: the save
+// waits until the line is quiet, and a page erase in the middle of a burst
+// (20 ms stall, the receive FIFO overflows) leaves the UART receiving
+static void check_config_rx(void){
+    static const char stay[] = "$PSTT,0*";
+    ControlData data = control_data;
+    unsigned int saves, overruns;
+    unsigned long lost;
+    int failed = 0, k;
+
+    scheduler_init(schedInfo, MAX_TASKS);
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    config_load();
+    control_data.state = WaitForStart;
+    saves = config_saves;
+    sim_uart_send("$PCTH,30,60*", 12);
+    for (k = 0; k < 5000; k++) {
+        if (k % 200 == 0)
+            sim_uart_send(stay, sizeof(stay) - 1);
+        sim_period();
+    }
+    failed += control_data.MINTH != 30 || config_saves != saves;  // Not while commands arrive
+    for (k = 0; k < 4000; k++)
+        sim_period();
+    failed += config_saves != saves + 1;
+
+    for (k = 0; k < 4; k++)
+        sim_uart_send(stay, sizeof(stay) - 1);
+    sim_advance(3 * (unsigned long long)FCY * 10 / 9600);
+    lost = sim.rx_lost;
+    overruns = hal_uart_rx_overruns();
+    for (k = 0; k < 40; k++)
+        config_save();  // A page erase among them
+    failed += sim.rx_lost == lost || hal_uart_rx_overruns() != overruns + 1 || sim.rx_oerr;
+    sim_uart_send("$PCTH,40,70*", 12);  // The first one closes the command cut by the overrun
+    sim_uart_send("$PCTH,40,70*", 12);
+    for (k = 0; k < 100; k++)
+        sim_period();
+    failed += control_data.MINTH != 40;
+
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    config_load();
+    control_data = data;
+    scheduler_init(schedInfo, MAX_TASKS);
+    report_failures("config/rx_failed_cases", failed, "cases");
+}
+
+static const benchmark benchmarks[] = {
+    { "format/sprintf_battery", bench_sprintf_battery },
+    { "format/msg_battery",     bench_msg_battery },
+    { "format/sprintf_pwm",     bench_sprintf_pwm },
+    { "format/msg_pwm",         bench_msg_pwm },
+    { "control/float_reference", bench_control_float },
+    { "control/q15",            bench_control_q15 },
+    { "pid/step",               bench_pid_step },
+    { "adc/poly_distance",      bench_adc_poly },
+    { "adc/lut_distance",       bench_adc_lut },
+    { "adc/get_measurements",   bench_get_measurements },
+    { "pwm/start",              bench_pwm_start },
+    { "pwm/start_unchanged",    bench_pwm_unchanged },
+    { "filter/average8_dsp",    bench_average_dsp },
+    { "filter/average8_ref",    bench_average_ref },
+    { "filter/median5",         bench_median5 },
+    { "filter/median5_slide",   bench_median5_slide },
+    { "filter/ema_dsp",         bench_ema_dsp },
+    { "filter/ema_ref",         bench_ema_ref },
+    { "filter/ir_chain",        bench_filter_chain },
+    { "config/load",            bench_config_load },
+    { "rx/push_pop",            bench_cb_push_pop },
+    { "rx/push12_pop_bulk",     bench_cb_bulk },
+    { "parse/pcth",             bench_parse_pcth },
+    { "parse/garbage_frames",   bench_parse_garbage },
+    { "parse/long_payload",     bench_parse_long_payload },
+    { "parse/overflow_payload", bench_parse_overflow },
+    { "cmd/dispatch",           bench_dispatch },
+    { "tlm/frame_snapshot",     bench_tlm_frame },
+    { "tlm/task_ascii",         bench_telemetry_ascii },
+    { "tlm/task_binary",        bench_telemetry_binary },
+    { "sched/tick",             bench_scheduler },
+    { "sched/many_tasks",       bench_scheduler_many },
+    { "sched/many_tasks_counter_scan", bench_scheduler_many_reference },
+};
+
+// Accuracy checks of the integer paths against their float references
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} check;
+
+static const check checks[] = {
+    { "control/max_oc_error", check_control_q15 },
+    { "pid/max_error",        check_pid },
+    { "adc/max_error",        check_adc_lut },
+    { "filter/dsp_vs_ref",    check_filters },
+    { "rx/stress",            check_cb_stress },
+    { "parse/fields",         check_parser },
+    { "cmd/dispatch",         check_dispatch },
+    { "tlm/codec",            check_tlm_codec },
+    { "perf/messages",        check_perf_messages },
+    { "motor/outputs",        check_motor },
+    { "timer/prescaler",      check_timer },
+    { "config/power_loss",    check_config },
+    { "config/rx_during_save", check_config_rx },
+};
+
+static long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void json_string(FILE* f, const char* s){
+    fputc('"', f);
+    for (; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\')
+            fputc('\\', f);
+        fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+// {"iterations": n, "benchmarks": [{"name", "ns_per_op", "ops_per_sec",
+// "cycles_per_op"}...], "checks": [{"name", "value", "unit"}...]}
+static int write_report(const char* path, long iterations){
+    FILE* f = fopen(path, "w");
+    int k, first;
+    if (f == NULL) {
+        perror(path);
+        return 0;
+    }
+    fprintf(f, "{\n  \"iterations\": %ld,\n  \"benchmarks\": [", iterations);
+    for (k = 0, first = 1; k < n_results; k++) {
+        if (results[k].unit != NULL)
+            continue;
+        fprintf(f, "%s\n    {\"name\": ", first ? "" : ",");
+        json_string(f, results[k].name);
+        fprintf(f, ", \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"cycles_per_op\": %.1f}",
+                results[k].ns, 1e9 / results[k].ns, results[k].cycles);
+        first = 0;
+    }
+    fprintf(f, "\n  ],\n  \"checks\": [");
+    for (k = 0, first = 1; k < n_results; k++) {
+        if (results[k].unit == NULL)
+            continue;
+        fprintf(f, "%s\n    {\"name\": ", first ? "" : ",");
+        json_string(f, results[k].name);
+        fprintf(f, ", \"value\": %.6g, \"unit\": ", results[k].ns);
+        json_string(f, results[k].unit);
+        fputc('}', f);
+        first = 0;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    return fclose(f) == 0;
+}
+
+// A benchmark is selected if no names were given or its name starts with one of them
+static int selected(const char* name, int argc, char** argv){
+    int k;
+    if (argc == 0)
+        return 1;
+    for (k = 0; k < argc; k++)
+        if (strncmp(name, argv[k], strlen(argv[k])) == 0)
+            return 1;
+    return 0;
+}
+
+int main(int argc, char** argv){
+    long iterations = 1000000;
+    const char* report = NULL;
+    int opt;
+    unsigned int k;
+
+    while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atol(optarg); break;
+            case 'o': report = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-o report.json] [name...]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (iterations <= 0)
+        iterations = 1;
+
+    sim_reset();
+    control_setup();
+
+    printf("%-30s %12s %14s %12s\n", "benchmark", "ns/op", "ops/s", "cycles/op");
+    for (k = 0; k < sizeof(benchmarks) / sizeof(benchmarks[0]); k++) {
+        const benchmark* b = &benchmarks[k];
+        if (!selected(b->name, argc - optind, argv + optind))
+            continue;
+
+        b->run(iterations / 10);  // Warm up caches and branch predictors
+        long long t0 = now_ns();
+#ifdef HAVE_TSC
+        unsigned long long c0 = __rdtsc();
+#endif
+        b->run(iterations);
+#ifdef HAVE_TSC
+        double cycles = (double)(__rdtsc() - c0) / iterations;
+#else
+        double cycles = 0;
+#endif
+        double ns = (double)(now_ns() - t0) / iterations;
+        printf("%-30s %12.2f %14.0f %12.1f\n", b->name, ns, 1e9 / ns, cycles);
+        if (n_results < MAX_RESULTS)
+            results[n_results++] = (result){ b->name, ns, cycles, NULL };
+    }
+    
+    printf("\n%-30s %12s %14s\n", "check", "value", "unit");
+    for (k = 0; k < sizeof(checks) / sizeof(checks[0]); k++) {
+        if (selected(checks[k].name, argc - optind, argv + optind))
+            checks[k].run();
+    }
+    
+    if (report != NULL && !write_report(report, iterations))
+        return 1;
+    if (checks_failed) {
+        printf("%d check(s) failed\n", checks_failed);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,369 @@
+/*
+ * File:   buggy_sim.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Closed-loop simulation of the buggy in a walled arena. The unmodified
+// firmware (control_setup, then sim_period: the control job, the command job
+// and the background tasks) runs against the simulated HAL; after every 1 ms iteration the plant reads
+// the OC1R..OC4R duties, moves the buggy and writes back the ADC codes the
+// sensors would read:
+// - motors: first order response of each wheel speed to its duty, scaled by
+//   the battery voltage (WHEEL_SPEED at V_NOMINAL, time constant MOTOR_TAU)
+// - differential drive kinematics with the wheels TRACK cm apart
+// - IR sensor: the code whose distance, through the polynomial of
+//   getMeasurements, is the distance of the closest wall in the spot of the
+//   sensor (IR_CONE either side of the heading; 14 to 234 cm, the monotonic
+//   part of the polynomial), plus -N codes of noise
+// - body: a rectangle around the wheel axle, its corners must stay inside
+// - battery: open circuit voltage falling with the charge used, minus the
+//   drop of the motor current on the internal resistance, through the divider
+//
+// The buggy starts at -x,-y cm heading -a degrees and the button is pressed at
+// start. The run ends after -t seconds or when the body hits a wall; with -c
+// the body slides along the wall instead and the contacts are counted. Metrics
+// go to stdout; -o writes the trajectory as CSV every -k ms. -S sweeps MINTH
+// and MAXTH over a grid and prints one line of metrics per pair, then the
+// pairs that ran without touching a wall; it exits with 1 if there are none.
+//
+// Usage: buggy_sim [-t seconds] [-m minth] [-M maxth] [-l law] [-N noise]
+//                  [-x cm] [-y cm] [-a deg] [-o trajectory.csv] [-k ms] [-c] [-S]
+
+#include "hal.h"
+#include "header.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARENA_W     300.0   // cm
+#define ARENA_H     200.0   // cm
+#define BODY_FRONT  12.0    // Body ahead of the wheel axle, cm
+#define BODY_REAR   6.0     // Body behind the wheel axle, cm
+#define BODY_HALF_W 9.0     // Half width of the body, wheels included, cm
+#define SENSOR_X    10.0    // IR sensor ahead of the wheel axle, cm
+#define IR_CONE     (10.0 * M_PI / 180)  // Half angle of the IR spot: the closest wall in it is read
+#define TRACK       15.0    // Distance between the wheels, cm
+#define WHEEL_SPEED 60.0    // Wheel speed at 100 % duty and V_NOMINAL, cm/s
+#define MOTOR_TAU   0.10    // s
+#define V_NOMINAL   7.4
+#define V_FULL      8.4     // Open circuit voltage when charged
+#define V_EMPTY     6.8
+#define CAPACITY    2000.0  // mAh
+#define R_INTERNAL  0.3     // Ohm
+#define I_IDLE      0.15    // A
+#define I_MOTOR     1.5     // A per motor at 100 % duty
+#define DT          (LOOP_PERIOD_US / 1e6)
+#define SWEEP_RUNS  24      // MINTH from 15 to 40 cm, MAXTH 10 to 40 cm above it
+
+typedef struct {
+    double x, y, heading;      // cm, cm, rad
+    double v_left, v_right;    // Wheel speeds, cm/s
+    double used_mah;
+    double battery;            // Terminal voltage
+} buggy;
+
+typedef struct {
+    double t_maxth, t_minth;   // First time the wall ahead was closer than MAXTH, MINTH (-1 never)
+    double crash_t;            // Time the body first hit a wall, -1 never
+    long contacts;             // Times the body hit a wall
+    double clearance;          // Closest approach of the body to a wall, cm
+    double path;               // cm travelled
+    double battery_min;        // V
+    double osc_lo, osc_hi;     // Range of the wall distance after reaching MAXTH
+    double surge_chatter;      // Mean |surge change| per PID period after reaching MAXTH, %
+    double sim_s, wall_s;
+} metrics;
+
+// IR code for each distance: codes of the decreasing part of the polynomial
+static double code_distance[1024];
+static int code_last;          // Code of the smallest distance (end of the decreasing part)
+
+static double poly_distance(int code){
+    double V = code * 3.3 / 1024.0;
+    return 100 * (2.34 - 4.74 * V + 4.06 * V * V - 1.60 * V * V * V + 0.24 * V * V * V * V);
+}
+
+static void sensor_init(void){
+    int code;
+    for (code = 0; code < 1024; code++)
+        code_distance[code] = poly_distance(code);
+    for (code_last = 0; code_last < 1023 && code_distance[code_last + 1] < code_distance[code_last]; code_last++)
+        ;
+}
+
+// Inverse of the polynomial by bisection over its decreasing part
+static unsigned int ir_code(double cm){
+    int lo = 0, hi = code_last;
+    if (cm >= code_distance[0])
+        return 0;
+    if (cm <= code_distance[code_last])
+        return code_last;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (code_distance[mid] > cm)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return (code_distance[lo] - cm < cm - code_distance[hi]) ? lo : hi;
+}
+
+// Distance from (x, y) to the first arena wall along the heading
+static double wall_ahead(double x, double y, double heading){
+    double c = cos(heading), s = sin(heading), d = 1e9;
+    if (c > 1e-9)
+        d = fmin(d, (ARENA_W - x) / c);
+    else if (c < -1e-9)
+        d = fmin(d, -x / c);
+    if (s > 1e-9)
+        d = fmin(d, (ARENA_H - y) / s);
+    else if (s < -1e-9)
+        d = fmin(d, -y / s);
+    return d;
+}
+
+// Corners of the body, clockwise from front left
+static void corners(const buggy* b, double cx[4], double cy[4]){
+    static const double fx[4] = {BODY_FRONT, BODY_FRONT, -BODY_REAR, -BODY_REAR};
+    static const double fy[4] = {BODY_HALF_W, -BODY_HALF_W, -BODY_HALF_W, BODY_HALF_W};
+    double c = cos(b->heading), s = sin(b->heading);
+    int k;
+    for (k = 0; k < 4; k++) {
+        cx[k] = b->x + fx[k] * c - fy[k] * s;
+        cy[k] = b->y + fx[k] * s + fy[k] * c;
+    }
+}
+
+// Closest approach of the body to a wall, negative when it overlaps one
+static double clearance(const buggy* b){
+    double cx[4], cy[4], d = 1e9;
+    int k;
+    corners(b, cx, cy);
+    for (k = 0; k < 4; k++)
+        d = fmin(d, fmin(fmin(cx[k], ARENA_W - cx[k]), fmin(cy[k], ARENA_H - cy[k])));
+    return d;
+}
+
+// Push the body back inside the arena, along the wall normals
+static void slide_back(buggy* b){
+    double cx[4], cy[4], dx = 0, dy = 0;
+    int k;
+    corners(b, cx, cy);
+    for (k = 0; k < 4; k++) {
+        dx = fmax(dx, -cx[k]);
+        dx = fmin(dx, ARENA_W - cx[k]);
+        dy = fmax(dy, -cy[k]);
+        dy = fmin(dy, ARENA_H - cy[k]);
+    }
+    b->x += dx;
+    b->y += dy;
+}
+
+// Signed duty of a wheel, forward positive
+static double wheel_duty(int forward, int backward){
+    return ((double)sim.oc_r[forward] - sim.oc_r[backward]) / sim.oc_rs[forward];
+}
+
+// One loop period of motors, battery and kinematics
+static void plant_step(buggy* b){
+    double left = wheel_duty(OC_LEFT_CW, OC_LEFT_CCW);
+    double right = wheel_duty(OC_RIGHT_CW, OC_RIGHT_CCW);
+    double scale = b->battery / V_NOMINAL;
+    double current = I_IDLE + I_MOTOR * (fabs(left) + fabs(right));
+    double v, w;
+
+    b->v_left += (WHEEL_SPEED * scale * left - b->v_left) * DT / MOTOR_TAU;
+    b->v_right += (WHEEL_SPEED * scale * right - b->v_right) * DT / MOTOR_TAU;
+    v = (b->v_left + b->v_right) / 2;
+    w = (b->v_right - b->v_left) / TRACK;
+    b->x += v * cos(b->heading) * DT;
+    b->y += v * sin(b->heading) * DT;
+    b->heading += w * DT;
+
+    b->used_mah += current * 1000 * DT / 3600;
+    b->battery = V_FULL - (V_FULL - V_EMPTY) * b->used_mah / CAPACITY - R_INTERNAL * current;
+}
+
+static void sensors(const buggy* b, double* ahead){
+    double sx = b->x + SENSOR_X * cos(b->heading), sy = b->y + SENSOR_X * sin(b->heading);
+    *ahead = fmin(wall_ahead(sx, sy, b->heading),
+                  fmin(wall_ahead(sx, sy, b->heading - IR_CONE), wall_ahead(sx, sy, b->heading + IR_CONE)));
+    sim.adc[ADC_IR] = ir_code(*ahead);
+    sim.adc[ADC_BATTERY] = (unsigned int)lround(b->battery / 3 * 1024 / 3.3);
+}
+
+static double now_s(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static metrics run(double seconds, int minth, int maxth, int law, int noise,
+                   double x, double y, double heading, int slide, FILE* csv, long every){
+    buggy b = {x, y, heading, 0, 0, 0, V_FULL};
+    metrics m = {-1, -1, -1, 0, 1e9, 0, V_FULL, 1e9, -1e9, 0, 0, 0};
+    int touching = 0;
+    long steps = seconds / DT, k, changes = 0;
+    int prev_surge = 0;
+    double ahead, start = now_s();
+
+    sim_reset();
+    sim.adc_noise = noise;
+    control_setup();
+    control_data.MINTH = minth;
+    control_data.MAXTH = maxth;
+    control_data.law = law;
+    if (csv != NULL)
+        fprintf(csv, "t,x,y,heading,ahead_cm,measured_cm,surge,yaw_rate,battery_v,state\n");
+
+    for (k = 0; k < steps; k++) {
+        double t = k * DT, px = b.x, py = b.y;
+        sensors(&b, &ahead);
+        if (k == 0 || k == 12)  // Press the button past the 10 ms debounce
+            sim_button(k == 0);
+        sim_period();
+        plant_step(&b);
+
+        m.path += hypot(b.x - px, b.y - py);
+        m.clearance = fmin(m.clearance, clearance(&b));
+        m.battery_min = fmin(m.battery_min, b.battery);
+        if (m.t_maxth < 0 && ahead < maxth)
+            m.t_maxth = t;
+        if (m.t_minth < 0 && ahead < minth)
+            m.t_minth = t;
+        if (m.t_maxth >= 0) {
+            m.osc_lo = fmin(m.osc_lo, ahead);
+            m.osc_hi = fmax(m.osc_hi, ahead);
+            if (control_data.surge != prev_surge) {
+                m.surge_chatter += abs(control_data.surge - prev_surge);
+                changes++;
+            }
+        }
+        prev_surge = control_data.surge;
+        if (csv != NULL && k % every == 0)
+            fprintf(csv, "%.3f,%.2f,%.2f,%.4f,%.2f,%.2f,%d,%d,%.3f,%d\n", t, b.x, b.y, b.heading,
+                    ahead, (double)loop_snapshot.distance / DIST_ONE, control_data.surge,
+                    control_data.yaw_rate, b.battery, loop_snapshot.state);
+        if (clearance(&b) < 0) {
+            m.contacts += !touching;
+            touching = 1;
+            if (m.crash_t < 0)
+                m.crash_t = t;
+            if (!slide) {
+                k++;
+                break;
+            }
+            slide_back(&b);
+        } else {
+            touching = 0;
+        }
+    }
+    if (changes > 0)
+        m.surge_chatter /= changes;
+    if (m.t_maxth < 0)
+        m.osc_lo = m.osc_hi = 0;
+    m.sim_s = k * DT;
+    m.wall_s = now_s() - start;
+    return m;
+}
+
+static void print_row(FILE* f, int minth, int maxth, const metrics* m){
+    fprintf(f, "%5d %5d %9.2f %9.2f %9.2f %8ld %9.1f %9.1f %7.1f %7.1f %8.2f %8.3f %8.0f\n",
+           minth, maxth, m->t_maxth, m->t_minth, m->crash_t, m->contacts, m->clearance, m->path / 100,
+           (m->osc_hi - m->osc_lo) / 2, m->surge_chatter, m->battery_min, m->wall_s,
+           m->sim_s / m->wall_s);
+}
+
+int main(int argc, char** argv){
+    double seconds = 60, x = 50, y = ARENA_H / 2, deg = 0;
+    int minth = 25, maxth = 50, law = LAW_PROPORTIONAL, noise = 0, slide = 0, sweep = 0, opt;
+    long every = 20;
+    const char* out = NULL;
+    FILE* csv = NULL;
+    static const char header[] = "minth maxth  t_maxth s t_minth s  crash s contacts clear cm   path m  osc cm  chat %%  batt V   wall s    x real\n";
+
+    while ((opt = getopt(argc, argv, "t:m:M:l:N:x:y:a:o:k:cS")) != -1) {
+        switch (opt) {
+            case 't': seconds = atof(optarg); break;
+            case 'm': minth = atoi(optarg); break;
+            case 'M': maxth = atoi(optarg); break;
+            case 'l': law = atoi(optarg); break;
+            case 'N': noise = atoi(optarg); break;
+            case 'x': x = atof(optarg); break;
+            case 'y': y = atof(optarg); break;
+            case 'a': deg = atof(optarg); break;
+            case 'o': out = optarg; break;
+            case 'k': every = atol(optarg); break;
+            case 'c': slide = 1; break;
+            case 'S': sweep = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-t seconds] [-m minth] [-M maxth] [-l law] [-N noise] [-x cm] [-y cm] [-a deg] [-o trajectory.csv] [-k ms] [-c] [-S]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (every <= 0)
+        every = 1;
+    sensor_init();
+
+    printf("arena %.0fx%.0f cm, start (%.0f, %.0f) cm at %.0f deg, %s law, %.0f s, noise +-%d codes\n",
+           ARENA_W, ARENA_H, x, y, deg, law == LAW_PID ? "PID" : "proportional", seconds, noise);
+    printf(header);
+    if (!sweep) {
+        metrics m;
+        if (out != NULL && (csv = fopen(out, "w")) == NULL) {
+            perror(out);
+            return 2;
+        }
+        m = run(seconds, minth, maxth, law, noise, x, y, deg * M_PI / 180, slide, csv, every);
+        if (csv != NULL)
+            fclose(csv);
+        print_row(stdout, minth, maxth, &m);
+        return m.crash_t >= 0;
+    }
+
+    // The firmware state lives in globals, so every run of the sweep gets a
+    // fresh process; the runs go in parallel and send back their metrics
+    int fds[SWEEP_RUNS][3], n = 0, k;
+    double start = now_s(), simulated = 0;
+    fflush(stdout);
+    for (minth = 15; minth <= 40; minth += 5) {
+        for (maxth = minth + 10; maxth <= minth + 40; maxth += 10) {
+            int p[2];
+            if (pipe(p) != 0)
+                return 2;
+            if (fork() == 0) {
+                metrics m = run(seconds, minth, maxth, law, noise, x, y, deg * M_PI / 180, slide, NULL, every);
+                _exit(write(p[1], &m, sizeof(m)) != sizeof(m));
+            }
+            close(p[1]);
+            fds[n][0] = p[0];
+            fds[n][1] = minth;
+            fds[n][2] = maxth;
+            n++;
+        }
+    }
+    char safe[SWEEP_RUNS * 12 + 1] = "";
+    int n_safe = 0;
+    for (k = 0; k < n; k++) {
+        metrics m;
+        if (read(fds[k][0], &m, sizeof(m)) == sizeof(m)) {
+            print_row(stdout, fds[k][1], fds[k][2], &m);
+            simulated += m.sim_s;
+            if (m.crash_t < 0 && m.sim_s >= seconds - DT) {
+                sprintf(safe + strlen(safe), " %d/%d", fds[k][1], fds[k][2]);
+                n_safe++;
+            }
+        }
+        close(fds[k][0]);
+    }
+    while (wait(NULL) > 0)
+        ;
+    printf("sweep of %d runs: %.0f simulated s in %.3f s (%.0f x real time)\n",
+           n, simulated, now_s() - start, simulated / (now_s() - start));
+    printf("no contact in %d runs (minth/maxth):%s\n", n_safe, n_safe ? safe : " none");
+    return n_safe == 0;
+}
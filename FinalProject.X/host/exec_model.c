@@ -0,0 +1,433 @@
+/*
+ * File:   exec_model.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Timing model of the firmware on the dsPIC: the simulated HAL runs the jobs
+// in no time, so how long the control job waits behind the rest is modelled
+// here, cycle by cycle, from the cost of each piece of work. The same load
+// runs under two policies:
+// - superloop: the firmware before the executive, one loop polling Timer1
+//   that filters, controls, parses the received bytes and runs the tasks in
+//   turn (only the interrupt vectors preempt it)
+// - executive: the control job at IPL_CONTROL off Timer1, the command job at
+//   IPL_COMMANDS posted by U2RX, the tasks in the background (main.c)
+// Both have the ADC vector at IPL_ADC and U2RX/U2TX at IPL_DEVICE. The
+// control latency is the time from the Timer1 period to the end of the
+// control update; for the executive it must stay within the bound of the
+// response time analysis: the control job (its hal_oc_write spin included),
+// the longest critical section of a lower job that masks it and the ADC
+// vectors meanwhile. Exits with 1 if the executive exceeds it.
+//
+// The critical sections are the ones of the firmware, their costs follow
+// from what they copy (sizes from the headers). A configuration save stops
+// the CPU while the flash is written (HAL_FLASH_*_US): it only happens while
+// the buggy waits for start, so it is left out of the bound and run apart,
+// the "saving" line reports the periods it costs.
+//
+// Usage: exec_model [-s seconds] [-b] [-c name=cycles]...
+// -b makes the sends blocking as they were before the transmit queue: the
+// tasks wait for every byte at 9600 baud. -c changes a cost, e.g. -c tlm=50000.
+
+#include "hal.h"
+#include "header.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PERIOD   ((long long)FCY * LOOP_PERIOD_US / 1000000)
+#define BYTE     ((long long)FCY * 10 / 9600)           // One byte at 9600 baud
+#define ADC_GAP  (ADC_SCANS_PER_IRQ * 2 * (16 + 12) * (14 + 1))
+#define CMD_LEN  12                                      // "$PCTH,20,45*"
+#define CMD_GAP  (100 * PERIOD)                          // A command every 100 ms
+#define TLM_LEN  40                                      // Bytes of a $MTLM
+
+// Cost of the pieces of the critical sections, in cycles
+#define SECTION   12  // hal_ipl_raise and hal_ipl_restore: calls, SR read and write
+#define COPY_WORD 2   // A 16 bit word copied
+#define PACK_BYTE 6   // A byte of the configuration payload: shift, mask, store
+#define LONG_DIV  50  // 32 by 16 bit division
+#define WORDS(t)  (sizeof(t) / sizeof(int))  // dsPIC words of a struct of ints and longs
+#define STALL_IPL 8   // Above every level: the CPU stops while the flash is written
+#define FLASH_US  (FCY / 1000000)
+
+// Costs in cycles, estimates for the dsPIC at FCY to be replaced with the
+// $MPERF figures of the buggy (-c)
+typedef struct {
+    const char* name;
+    long cycles;
+} cost;
+
+static cost costs[] = {
+    { "control", 6000 },    // Filters, PID and mixing (PERF_LOOP)
+    { "adc",     80 },      // ADC vector
+    { "rx",      60 },      // U2RX vector, per byte
+    { "tx",      60 },      // U2TX vector, per byte
+    { "parse",   40 },      // Parser, per byte
+    { "ack",     1500 },    // $MACK formatting and queueing
+    { "blink",   200 },     // LED tasks
+    { "tlm",     20000 },   // Telemetry task
+    { "perf",    15000 },   // $MPERF task
+    { "save",    3000 },    // Configuration task: compare, CRC, read back
+    // Section at IPL 7 in the control job: hal_oc_write waits for the guard
+    // and writes the four OCxR
+    { "oc",       SECTION + HAL_OC_GUARD + 4 * COPY_WORD },
+    // Sections of the lower jobs that mask the control job
+    { "apply",    400 },    // Command handler (isr_commands)
+    { "latency",  SECTION + 20 },                  // Period count and TMR1 (loop_time_us)
+    { "release",  SECTION + 2 * COPY_WORD + 4 },   // A task release (scheduler_run)
+    { "snapshot", SECTION + COPY_WORD * (WORDS(LoopSnapshot) + 2 + 8) },  // task_send_telemetry
+    { "stats",    SECTION + COPY_WORD * (WORDS(PerfStats) + 1) },         // task_send_perf
+    { "capture",  SECTION + PACK_BYTE * CONFIG_PAYLOAD + LONG_DIV * MAX_TASKS },  // config_capture
+    // CPU stalls of a configuration save
+    { "program",  HAL_FLASH_PROGRAM_US * FLASH_US },
+    { "erase",    HAL_FLASH_ERASE_US * FLASH_US },
+};
+enum { C_CONTROL, C_ADC, C_RX, C_TX, C_PARSE, C_ACK, C_BLINK, C_TLM, C_PERF, C_SAVE, C_OC,
+       C_APPLY, C_LATENCY, C_RELEASE, C_SNAPSHOT, C_STATS, C_CAPTURE, C_PROGRAM, C_ERASE, C_COUNT };
+#define COST(c) (costs[c].cycles)
+#define FIRST_SECTION C_APPLY   // C_APPLY..C_CAPTURE mask the control job
+#define LAST_SECTION  C_CAPTURE
+
+// A job is a sequence of segments, each at a priority: the priority of the
+// job or the one of a critical section it enters
+typedef struct {
+    int ipl;
+    long long cycles;
+    int mark;           // Event recorded when the segment ends
+} segment;
+
+enum { MARK_NONE, MARK_CONTROL, MARK_COMMAND, MARK_LOOP, MARK_RX, MARK_ADC };
+
+#define MAX_SEGMENTS (8 + 2 * CONFIG_RECORD / HAL_FLASH_WORD)
+#define MAX_JOBS 256
+
+typedef struct {
+    segment seg[MAX_SEGMENTS];
+    int n, cur;
+    long long left;     // Of the current segment
+    long long order;    // Release order, FIFO among equal priorities
+    long long stamp;    // Period or byte the job answers to
+} job;
+
+typedef struct {
+    long long sum, max, count;
+    long long min;
+} stat;
+
+static job jobs[MAX_JOBS];
+static int njobs;
+static long long released;
+static int blocking;
+static int executive;   // Policy of the run
+static int saving;      // The configuration task saves (the buggy waits for start)
+static long saves;
+
+static void stat_add(stat* s, long long v){
+    if (s->count == 0 || v < s->min)
+        s->min = v;
+    if (v > s->max)
+        s->max = v;
+    s->sum += v;
+    s->count++;
+}
+
+static job* job_new(long long stamp){
+    job* j;
+    if (njobs == MAX_JOBS) {
+        fprintf(stderr, "too many jobs pending\n");
+        exit(2);
+    }
+    j = &jobs[njobs++];
+    memset(j, 0, sizeof(*j));
+    j->order = released++;
+    j->stamp = stamp;
+    return j;
+}
+
+static void job_add(job* j, int ipl, long long cycles, int mark){
+    if (j->n == MAX_SEGMENTS) {
+        fprintf(stderr, "too many segments\n");
+        exit(2);
+    }
+    j->seg[j->n++] = (segment){ ipl, cycles, mark };
+    if (j->n == 1)
+        j->left = cycles;
+}
+
+// The job the CPU runs: the highest priority, then the first released
+static job* job_running(void){
+    job* best = NULL;
+    int k;
+    for (k = 0; k < njobs; k++) {
+        job* j = &jobs[k];
+        if (best == NULL || j->seg[j->cur].ipl > best->seg[best->cur].ipl ||
+            (j->seg[j->cur].ipl == best->seg[best->cur].ipl && j->order < best->order))
+            best = j;
+    }
+    return best;
+}
+
+// A critical section of a lower job: it masks the control job in the
+// executive, the superloop had none
+static void add_section(job* j, int ipl, int c){
+    job_add(j, executive ? IPL_CONTROL : ipl, COST(c), MARK_NONE);
+}
+
+// Configuration save: the record is programmed a flash word at a time, the
+// vectors run between the stalls; every CONFIG_SLOTS saves the next page is
+// erased first, the first save of the run included
+static void add_save(job* j, int ipl){
+    int k;
+    add_section(j, ipl, C_CAPTURE);
+    if (saves++ % CONFIG_SLOTS == 0)
+        job_add(j, STALL_IPL, COST(C_ERASE), MARK_NONE);
+    for (k = 0; k < CONFIG_RECORD / HAL_FLASH_WORD; k++) {
+        job_add(j, STALL_IPL, COST(C_PROGRAM), MARK_NONE);
+        job_add(j, ipl, 20, MARK_NONE);
+    }
+}
+
+// Tasks released at a tick, with their phases in main.c. The telemetry and
+// $MPERF tasks queue a message, the configuration task saves when saving
+static void add_tasks(job* j, int ipl, long long tick){
+    int k;
+    for (k = 0; k < MAX_TASKS; k++) {
+        if (tick % 1000 != k)
+            continue;
+        add_section(j, ipl, C_RELEASE);
+        if (k < 2) {
+            job_add(j, ipl, COST(C_BLINK), MARK_NONE);
+        } else if (k < 4) {
+            add_section(j, ipl, k == 2 ? C_SNAPSHOT : C_STATS);
+            job_add(j, ipl, COST(k == 2 ? C_TLM : C_PERF), MARK_NONE);
+            if (blocking)
+                job_add(j, ipl, TLM_LEN * BYTE, MARK_NONE);  // Waits for the UART
+        } else if (saving) {
+            add_section(j, ipl, C_CAPTURE);
+            job_add(j, ipl, COST(C_SAVE), MARK_NONE);
+            add_save(j, ipl);
+        }
+    }
+}
+
+typedef struct {
+    stat control;       // Timer1 period to the end of the control update, cycles
+    stat command;       // Last byte of a command to its handler
+    long long missed;   // Periods without a control update
+    long long adc_lost; // ADC interrupts still pending at the next one
+    long long busy;     // Cycles the CPU was not idle
+} result;
+
+// The control update: the job, then the motor outputs with all the
+// interrupts masked
+static void add_control(job* j, int ipl){
+    job_add(j, ipl, COST(C_CONTROL), MARK_NONE);
+    job_add(j, 7, COST(C_OC), MARK_CONTROL);
+}
+
+// Run the model for the given number of periods under one policy
+static result run(int policy, int save, long long periods){
+    long long now = 0, end = periods * PERIOD;
+    long long next_t1 = PERIOD, next_adc = ADC_GAP, next_cmd = PERIOD / 2, next_tx = 0;
+    int cmd_byte = 0, t1_flag = 0, loop_busy = 0, control_pending = 0, adc_pending = 0;
+    long long rx_pending = 0, commands_pending = 0, last_byte = 0, last_t1 = 0, tick = 0;
+    result r;
+
+    memset(&r, 0, sizeof(r));
+    njobs = 0;
+    released = 0;
+    executive = policy;
+    saving = save;
+    saves = 0;
+    while (now < end) {
+        job* j = job_running();
+        long long next = next_t1;
+        if (next_adc < next) next = next_adc;
+        if (next_cmd < next) next = next_cmd;
+        if (next_tx < next) next = next_tx;
+
+        // Superloop: a new iteration starts as soon as Timer1 has expired
+        if (!executive && !loop_busy && t1_flag) {
+            job* l = job_new(last_t1);
+            t1_flag = 0;
+            add_control(l, 0);
+            // The bytes received since the last iteration
+            job_add(l, 0, rx_pending * COST(C_PARSE), MARK_NONE);
+            for (; commands_pending > 0; commands_pending--) {
+                job_add(l, 0, COST(C_APPLY), MARK_COMMAND);
+                job_add(l, 0, COST(C_ACK), MARK_NONE);
+                job_add(l, 0, COST(C_LATENCY), MARK_NONE);
+            }
+            rx_pending = 0;
+            add_tasks(l, 0, tick - 1);
+            job_add(l, 0, 0, MARK_LOOP);
+            loop_busy = 1;
+            continue;
+        }
+
+        if (j != NULL && now + j->left <= next) {
+            // The running segment ends first
+            now += j->left;
+            r.busy += j->left;
+            segment* s = &j->seg[j->cur];
+            if (s->mark == MARK_CONTROL) {
+                stat_add(&r.control, now - j->stamp);
+                control_pending--;
+            } else if (s->mark == MARK_COMMAND) {
+                stat_add(&r.command, now - last_byte);
+            } else if (s->mark == MARK_LOOP) {
+                loop_busy = 0;
+            } else if (s->mark == MARK_ADC) {
+                adc_pending = 0;
+            } else if (s->mark == MARK_RX && executive) {
+                // U2RX posts the command job, the handler masks the control job
+                job* c = job_new(now);
+                job_add(c, IPL_COMMANDS, COST(C_PARSE), MARK_NONE);
+                if (j->stamp) {
+                    job_add(c, IPL_CONTROL, COST(C_APPLY), MARK_COMMAND);
+                    job_add(c, IPL_COMMANDS, COST(C_ACK), MARK_NONE);
+                    add_section(c, IPL_COMMANDS, C_LATENCY);
+                }
+            }
+            if (++j->cur < j->n) {
+                j->left = j->seg[j->cur].cycles;
+            } else {
+                *j = jobs[--njobs];
+            }
+            continue;
+        }
+
+        // An event comes first
+        if (j != NULL) {
+            j->left -= next - now;
+            r.busy += next - now;
+        }
+        now = next;
+        if (now == next_t1) {
+            next_t1 += PERIOD;
+            if (executive) {
+                job* t;
+                if (control_pending > 0) {
+                    r.missed++;     // The previous job has not ended yet, the flag is still set
+                } else {
+                    add_control(job_new(now), IPL_CONTROL);
+                    control_pending++;
+                }
+                t = job_new(now);
+                add_tasks(t, 0, tick);
+                if (t->n == 0)
+                    njobs--;
+            } else {
+                if (t1_flag)
+                    r.missed++;     // The previous period was never served
+                t1_flag = 1;
+                last_t1 = now;
+            }
+            tick++;
+        } else if (now == next_adc) {
+            next_adc += ADC_GAP;
+            if (adc_pending) {
+                r.adc_lost++;       // Its half of ADC1BUF is overwritten
+            } else {
+                job_add(job_new(now), IPL_ADC, COST(C_ADC), MARK_ADC);
+                adc_pending = 1;
+            }
+        } else if (now == next_cmd) {
+            // Bytes of a command, BYTE apart
+            job* rx = job_new(now);
+            cmd_byte++;
+            rx->stamp = (cmd_byte == CMD_LEN);  // Completes the command
+            job_add(rx, IPL_DEVICE, COST(C_RX), MARK_RX);
+            if (!executive) {
+                rx_pending++;
+                commands_pending += (cmd_byte == CMD_LEN);
+            }
+            if (cmd_byte == CMD_LEN) {
+                last_byte = now;
+                cmd_byte = 0;
+                next_cmd += CMD_GAP - (CMD_LEN - 1) * BYTE;
+            } else {
+                next_cmd += BYTE;
+            }
+        } else if (now == next_tx) {
+            // The UART is always sending: a U2TX vector per byte
+            next_tx += BYTE;
+            job_add(job_new(now), IPL_DEVICE, COST(C_TX), MARK_NONE);
+        }
+    }
+    return r;
+}
+
+static void report(const char* name, const result* r, long long periods){
+    printf("%-10s %9.1f %9.1f %9.1f %10.1f %9lld %8lld %8.1f\n", name,
+           r->control.min * 1e6 / FCY, (double)r->control.sum / r->control.count * 1e6 / FCY,
+           r->control.max * 1e6 / FCY, r->command.max * 1e6 / FCY, r->missed, r->adc_lost,
+           100.0 * r->busy / (periods * PERIOD));
+}
+
+int main(int argc, char** argv){
+    double seconds = 2;
+    int opt, k, longest = FIRST_SECTION;
+    long long periods, bound, prev, blocked;
+
+    while ((opt = getopt(argc, argv, "s:bc:")) != -1) {
+        switch (opt) {
+            case 's': seconds = atof(optarg); break;
+            case 'b': blocking = 1; break;
+            case 'c': {
+                const char* eq = strchr(optarg, '=');
+                for (k = 0; k < C_COUNT; k++)
+                    if (eq && (size_t)(eq - optarg) == strlen(costs[k].name) && strncmp(optarg, costs[k].name, eq - optarg) == 0)
+                        break;
+                if (k == C_COUNT) {
+                    fprintf(stderr, "unknown cost %s\n", optarg);
+                    return 2;
+                }
+                costs[k].cycles = atol(eq + 1);
+                break;
+            }
+            default:
+                fprintf(stderr, "usage: %s [-s seconds] [-b] [-c name=cycles]...\n", argv[0]);
+                return 2;
+        }
+    }
+    periods = seconds * 1000000 / LOOP_PERIOD_US;
+
+    printf("costs (cycles):");
+    for (k = 0; k < C_COUNT; k++)
+        printf(" %s %ld", costs[k].name, costs[k].cycles);
+    printf("%s\n", blocking ? ", blocking sends" : "");
+    printf("%-10s %9s %9s %9s %10s %9s %8s %8s\n", "policy", "ctl min", "ctl mean", "ctl max",
+           "cmd max", "missed", "adc lost", "cpu %");
+    printf("%-10s %9s %9s %9s %10s %9s %8s %8s\n", "", "us", "us", "us", "us", "periods", "", "");
+    result loop = run(0, 0, periods);
+    result exec = run(1, 0, periods);
+    result save = run(1, 1, periods);
+    report("superloop", &loop, periods);
+    report("executive", &exec, periods);
+    report("saving", &save, periods);
+
+    // Response time of the control job: its cost with the hal_oc_write
+    // section, blocked by the longest section of a lower job, preempted by
+    // the ADC vectors that fall in the window
+    for (k = FIRST_SECTION; k <= LAST_SECTION; k++)
+        if (COST(k) > COST(longest))
+            longest = k;
+    blocked = COST(C_CONTROL) + COST(C_OC) + COST(longest);
+    bound = blocked;
+    do {
+        prev = bound;
+        bound = blocked + (prev + ADC_GAP - 1) / ADC_GAP * COST(C_ADC);
+    } while (bound != prev);
+    printf("executive bound %.1f us (control %ld + oc %ld + %s %ld + ADC vectors)\n",
+           bound * 1e6 / FCY, COST(C_CONTROL), COST(C_OC), costs[longest].name, COST(longest));
+    printf("saving (only while the buggy waits for start): control up to %.1f ms late\n",
+           save.control.max * 1e3 / FCY);
+    if (exec.control.max > bound || exec.missed > 0 || exec.adc_lost > 0) {
+        printf("FAIL: the control latency of the executive exceeds the bound\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,576 @@
+/*
+ * File:   hal_sim.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+sim_machine sim;
+
+static const int prescaler[4] = {1, 8, 64, 256};
+
+// Cycles of one timer period ((PRx + 1) * prescaler)
+static unsigned long long timer_cycles(const sim_timer* t){
+    return (unsigned long long)(t->period + 1) * prescaler[t->tckps];
+}
+
+// 10 bit times per byte, the TX FIFO holds 4 bytes besides the shift register
+static unsigned long long byte_cycles(void){
+    return (unsigned long long)FCY * 10 / sim.baud;
+}
+
+// Cycle at which the TX FIFO has at least one free slot
+static unsigned long long tx_space_at(void){
+    unsigned long long fifo = 4 * byte_cycles();
+    return (sim.tx_free_at > fifo) ? sim.tx_free_at - fifo : 0;
+}
+
+// Run the control job if Timer1 expired while it was masked, then the
+// command job if it is pending, as far as the priority allows them
+static void control_irq_check(void){
+    if (sim.t1_pending && sim.ipl < IPL_CONTROL && !sim.stalled) {
+        int old = sim.ipl;
+        sim.t1_pending = 0;
+        sim.ipl = IPL_CONTROL;
+        sim.in_isr++;
+        sim.timer[TIMER1].flag = 0;   // Same sequence as _T1Interrupt in hal.c
+        sim.timer[TIMER1].polled = 0;
+        isr_control_period();
+        sim.in_isr--;
+        sim.ipl = old;
+    }
+}
+
+static int run_until(unsigned long long target, int wake);
+
+static void soft_irq_check(void){
+    control_irq_check();
+    while (sim.soft_pending && sim.soft_irq_enabled && sim.ipl < IPL_COMMANDS && !sim.stalled) {
+        int old = sim.ipl;
+        sim.soft_pending = 0;
+        sim.ipl = IPL_COMMANDS;
+        sim.in_isr++;
+        run_until(sim.cycles + sim.command_cycles, 0);
+        isr_commands();
+        sim.in_isr--;
+        sim.ipl = old;
+    }
+}
+
+// Entry and exit of an interrupt vector at the given priority
+static int vector_enter(int ipl){
+    int old = sim.ipl;
+    sim.ipl = ipl;
+    sim.in_isr++;
+    return old;
+}
+
+static void vector_exit(int old){
+    sim.in_isr--;
+    sim.ipl = old;
+    soft_irq_check();
+}
+
+// Run the U2TX vector as long as it is enabled and the FIFO has room
+static void tx_service(void){
+    while (sim.tx_irq_enabled && tx_space_at() <= sim.cycles) {
+        unsigned long before = sim.tx_bytes;
+        int old = vector_enter(IPL_DEVICE);
+        isr_uart_tx();
+        vector_exit(old);
+        if (sim.tx_bytes == before)
+            break;
+    }
+}
+
+// Deliver the bytes received while the RX interrupt was masked, then clear
+// an overrun (same sequence as _U2RXInterrupt in hal.c)
+static void rx_flush(void){
+    int k;
+    for (k = 0; k < sim.rx_count; k++) {
+        int old = vector_enter(IPL_DEVICE);
+        isr_uart_rx(sim.rx_pending[k]);
+        vector_exit(old);
+    }
+    sim.rx_count = 0;
+    if (sim.rx_oerr) {
+        sim.rx_oerr = 0;
+        sim.rx_overruns++;
+    }
+}
+
+// Same sequence as _T2Interrupt in hal.c
+static void t2_vector(void){
+    int old = vector_enter(IPL_DEVICE);
+    sim.timer[TIMER2].flag = 0;
+    sim.timer[TIMER2].on = 0;
+    isr_debounce_elapsed();
+    sim.int1_enabled = 1;
+    vector_exit(old);
+}
+
+void sim_reset(void){
+    memset(&sim, 0, sizeof(sim));
+    memset(sim.flash, 0xFF, sizeof(sim.flash));
+    sim.command_cycles = SIM_COMMAND_CYCLES;
+}
+
+// IR code of the next ADC interrupt, with the noise of the sensor
+static unsigned int ir_code(void){
+    long code = sim.adc[ADC_IR] & 0x3FF;
+    if (sim.adc_noise > 0) {
+        sim.noise_seed = sim.noise_seed * 1103515245UL + 12345;
+        code += (long)((sim.noise_seed >> 16) % (2 * sim.adc_noise + 1)) - sim.adc_noise;
+    }
+    return (code < 0) ? 0 : (code > 1023) ? 1023 : code;
+}
+
+// Cycles between two ADC interrupts: ADC_SCANS_PER_IRQ scans of two
+// conversions of (SAMC + 12) Tad each, Tad = (ADCS + 1) Tcy
+#define ADC_IRQ_CYCLES (ADC_SCANS_PER_IRQ * 2 * (16 + 12) * (14 + 1))
+
+// Move time forward up to target, running the interrupt vectors that fall in
+// the interval. With wake set, stop at the first interrupt that would wake the
+// CPU from Idle (an enabled one, masked or not). Returns 1 if it stopped there.
+// The ADC interrupt is left out: it releases no background work, the firmware
+// would go back to Idle right after it
+static int run_until(unsigned long long target, int wake){
+    enum { SRC_NONE, SRC_TIMER, SRC_ADC, SRC_UART_TX, SRC_UART_RX };
+    int tx_stuck = 0, woken = 0;
+
+    while (!woken) {
+        // Earliest event within the interval
+        unsigned long long when = target + 1;
+        int src = SRC_NONE, id, timer = 0;
+        for (id = TIMER1; id <= TIMER45; id++) {
+            if (sim.timer[id].on && sim.timer[id].next < when) {
+                when = sim.timer[id].next;
+                src = SRC_TIMER;
+                timer = id;
+            }
+        }
+        if (sim.adc_on && sim.adc_next < when) {
+            when = sim.adc_next;
+            src = SRC_ADC;
+        }
+        if (sim.tx_irq_enabled && !tx_stuck && !sim.stalled && tx_space_at() <= when) {
+            when = tx_space_at();
+            src = SRC_UART_TX;
+        }
+        if (sim.rx_line_count > 0 && sim.rx_line_next < when) {
+            when = sim.rx_line_next;
+            src = SRC_UART_RX;
+        }
+        if (src == SRC_NONE)
+            break;
+        if (when > sim.cycles)
+            sim.cycles = when;
+
+        switch (src) {
+            case SRC_TIMER: {
+                sim_timer* t = &sim.timer[timer];
+                t->next += timer_cycles(t);
+                t->flag = 1;
+                if (timer == TIMER1 && sim.t1_irq_enabled) {
+                    // Runs once the priority drops below IPL_CONTROL
+                    sim.t1_pending = 1;
+                    control_irq_check();
+                    woken = wake;
+                }
+                if (timer == TIMER2 && sim.t2_irq_enabled) {
+                    if (sim.stalled)
+                        sim.t2_pending = 1;
+                    else
+                        t2_vector();
+                    woken = wake;
+                }
+                break;
+            }
+            case SRC_ADC: {
+                sim.adc_next += ADC_IRQ_CYCLES;
+                if (!sim.stalled) {  // Else the next half of ADC1BUF overwrites it
+                    int old = vector_enter(IPL_ADC);
+                    isr_adc(sim.adc[ADC_BATTERY] & 0x3FF, ir_code());
+                    vector_exit(old);
+                }
+                break;
+            }
+            case SRC_UART_RX:
+                sim_uart_receive(sim.rx_line[sim.rx_line_head]);
+                sim.rx_line_head = (sim.rx_line_head + 1) % sizeof(sim.rx_line);
+                sim.rx_line_count--;
+                sim.rx_line_next += byte_cycles();
+                woken = wake;
+                break;
+            case SRC_UART_TX: {
+                unsigned long before = sim.tx_bytes;
+                tx_service();
+                tx_stuck = (sim.tx_bytes == before);  // The handler left the queue untouched
+                woken = wake && !tx_stuck;
+                break;
+            }
+        }
+    }
+    if (!woken)
+        sim.cycles = target;
+    return woken;
+}
+
+// Move time forward, running the interrupt vectors that fall in the interval
+void sim_advance(unsigned long long cycles){
+    run_until(sim.cycles + cycles, 0);
+}
+
+// One period of the firmware main loop: the background loop idles, woken by
+// each interrupt, until the Timer1 interrupt has run the control job; then
+// the background tasks it released
+void sim_period(void){
+    sim_timer* t = &sim.timer[TIMER1];
+    unsigned long long due = t->next;
+    while (t->on && sim.t1_irq_enabled && t->next == due) {
+        background_step();
+        background_idle();
+    }
+    if (!sim.t1_irq_enabled && t->on && t->next > sim.cycles) {
+        sim.idle_cycles += t->next - sim.cycles;
+        sim_advance(t->next - sim.cycles);
+    }
+    background_step();
+}
+
+// Byte arriving on U2RX
+void sim_uart_receive(char data){
+    if (sim.rx_oerr) {
+        sim.rx_lost++;
+    } else if (sim.rx_irq_enabled && !sim.stalled) {
+        int old = vector_enter(IPL_DEVICE);
+        isr_uart_rx(data);
+        vector_exit(old);
+    } else if (sim.rx_count < (int)sizeof(sim.rx_pending)) {
+        sim.rx_pending[sim.rx_count++] = data;
+    } else {
+        sim.rx_oerr = 1;
+        sim.rx_lost++;
+    }
+}
+
+// Bytes sent to UART2 back to back: they are received one every byte time,
+// from now or after the ones still on their way. Returns the bytes queued
+int sim_uart_send(const char* data, int len){
+    int k;
+    if (sim.rx_line_count == 0)
+        sim.rx_line_next = sim.cycles + byte_cycles();
+    for (k = 0; k < len && sim.rx_line_count < (int)sizeof(sim.rx_line); k++) {
+        sim.rx_line[(sim.rx_line_head + sim.rx_line_count) % sizeof(sim.rx_line)] = data[k];
+        sim.rx_line_count++;
+    }
+    return k;
+}
+
+// RE8 level change, rising edges trigger INT1 as in _INT1Interrupt
+void sim_button(int pressed){
+    int rising = pressed && !sim.gpio[SIM_BUTTON];
+    sim.gpio[SIM_BUTTON] = pressed;
+    if (rising && sim.int1_enabled) {
+        int old = vector_enter(IPL_DEVICE);
+        sim.int1_enabled = 0;
+        isr_button_pressed();
+        vector_exit(old);
+    }
+}
+
+void hal_board_init(void){
+    memset((void*)sim.gpio, 0, sizeof(sim.gpio));
+}
+
+void hal_interrupts_init(void){
+    sim.int1_enabled = 1;
+    sim.t2_irq_enabled = 1;
+    sim.rx_irq_enabled = 1;
+    sim.soft_irq_enabled = 1;
+}
+
+int hal_ipl_raise(int ipl){
+    int old = sim.ipl;
+    if (ipl > old)
+        sim.ipl = ipl;
+    return old;
+}
+
+void hal_ipl_restore(int ipl){
+    sim.ipl = ipl;
+    soft_irq_check();
+}
+
+void hal_soft_irq_post(void){
+    sim.soft_pending = 1;
+    soft_irq_check();
+}
+
+// Host time spent in hal_idle(), scaled to Fcy, and simulated time it skipped
+static unsigned long long idle_host_cycles, idle_sim_cycles;
+static unsigned long long host_cycles(void);
+
+// Up to the next interrupt that wakes the CPU, at most one second
+void hal_idle(void){
+    unsigned long long start = sim.cycles, host = host_cycles();
+    run_until(sim.cycles + FCY, 1);
+    sim.idle_cycles += sim.cycles - start;
+    idle_sim_cycles += sim.cycles - start;
+    idle_host_cycles += host_cycles() - host;
+}
+
+void hal_timer_config(int timer, int tckps, unsigned long period){
+    sim_timer* t = &sim.timer[timer];
+    t->tckps = tckps;
+    t->period = period;
+    t->flag = 0;
+    t->polled = 0;
+    t->on = 1;
+    t->next = sim.cycles + timer_cycles(t);
+}
+
+// Only Timer1 and Timer2 have a handler, as in hal.c; the target ignores the
+// others, the simulation stops on them as a firmware error
+void hal_timer_irq(int timer, int enable){
+    switch (timer) {
+        case TIMER1: sim.t1_irq_enabled = enable; break;
+        case TIMER2: sim.t2_irq_enabled = enable; break;
+        default:
+            fprintf(stderr, "hal_timer_irq: timer %d has no interrupt handler\n", timer);
+            abort();
+    }
+}
+
+void hal_timer_stop(int timer){
+    sim.timer[timer].on = 0;
+}
+
+// The first poll after a clear reports the flag as it is, so the firmware
+// can check for a missed deadline; polling again a timer that has not
+// expired yet sleeps until it does
+int hal_timer_elapsed(int timer){
+    sim_timer* t = &sim.timer[timer];
+    if (!t->polled) {
+        t->polled = 1;
+        if (timer == TIMER1 && t->flag)
+            sim.overruns++;
+    } else if (!t->flag && t->on) {
+        unsigned long long gap = t->next - sim.cycles;
+        if (timer == TIMER1)
+            sim.idle_cycles += gap;
+        sim_advance(gap);
+    }
+    return t->flag;
+}
+
+void hal_timer_clear(int timer){
+    sim.timer[timer].flag = 0;
+    sim.timer[timer].polled = 0;
+}
+
+// Counts since the last period reset
+unsigned long hal_timer_count(int timer){
+    sim_timer* t = &sim.timer[timer];
+    unsigned long long into;
+    if (!t->on)
+        return 0;
+    into = timer_cycles(t) - (t->next - sim.cycles);
+    return into / prescaler[t->tckps];
+}
+
+unsigned long hal_timer_period(int timer){
+    return sim.timer[timer].period;
+}
+
+// The simulated clock does not advance while the firmware computes, so the
+// cycle counter follows the host clock instead, scaled to Fcy: probes report
+// the host cost of each stage in dsPIC cycles at the same wall-clock time.
+// The time spent in hal_idle() counts as the simulated time it skipped, so
+// the idle and busy cycles of the CPU load add up to the simulated time plus
+// the host cost of the work
+static unsigned long long host_cycles(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL + ts.tv_nsec) * (FCY / 1000000) / 1000;
+}
+
+void hal_cycles_init(void){
+}
+
+unsigned long hal_cycles(void){
+    return (unsigned long)(host_cycles() - idle_host_cycles + idle_sim_cycles);
+}
+
+// Bits 31..16 of the accumulator, rounded and saturated to 16 bits
+int sim_sacr(sim_acc a){
+    sim_acc r = (a + 0x8000) >> 16;
+    if (r > 32767)
+        return 32767;
+    if (r < -32768)
+        return -32768;
+    return (int)r;
+}
+
+// Free running scan, the first interrupt comes after ADC_IRQ_CYCLES
+void hal_adc_init(void){
+    sim.gpio[SIM_IR_ENABLE] = 1;
+    sim.adc_on = 1;
+    sim.adc_next = sim.cycles + ADC_IRQ_CYCLES;
+}
+
+void hal_uart_init(long baud){
+    sim.baud = baud;
+    sim.tx_free_at = sim.cycles;
+}
+
+// Polled from the main loop a full FIFO spins until a slot frees up,
+// polled from an interrupt handler it only reports the status
+int hal_uart_tx_full(void){
+    unsigned long long space = tx_space_at();
+    if (space > sim.cycles) {
+        if (!sim.in_isr) {
+            sim.spin_cycles += space - sim.cycles;
+            sim_advance(space - sim.cycles);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+void hal_uart_write(char data){
+    if (sim.tx_free_at < sim.cycles)
+        sim.tx_free_at = sim.cycles;
+    sim.tx_free_at += byte_cycles();
+    sim.tx_bytes++;
+    if (sim.tx_sink)
+        sim.tx_sink(data);
+}
+
+void hal_uart_rx_irq(int enable){
+    sim.rx_irq_enabled = enable;
+    if (enable)
+        rx_flush();
+}
+
+unsigned int hal_uart_rx_overruns(void){
+    return sim.rx_overruns;
+}
+
+// U2TXIF stays set while the FIFO has room, so enabling fires the vector
+void hal_uart_tx_irq(int enable){
+    sim.tx_irq_enabled = enable;
+    if (enable && !sim.in_isr)
+        tx_service();
+}
+
+void hal_oc_init(unsigned int period){
+    int k;
+    for (k = 0; k < 4; k++) {
+        sim.oc_rs[k] = period;
+        sim.oc_r[k] = 0;
+    }
+}
+
+// All the writes land at the same period boundary, as on the target
+void hal_oc_write(const unsigned int duty[4], int mask){
+    int k;
+    for (k = 0; k < 4; k++) {
+        if (mask & (1 << k)) {
+            sim.oc_r[k] = duty[k];
+            sim.oc_writes++;
+        }
+    }
+    if ((sim.oc_r[OC_LEFT_CCW] && sim.oc_r[OC_LEFT_CW]) || (sim.oc_r[OC_RIGHT_CCW] && sim.oc_r[OC_RIGHT_CW]))
+        sim.oc_overlaps++;
+}
+
+// Keep the flash in the file at path: load it if it exists (else the flash
+// stays erased) and write it back after each operation. Returns -1 if the
+// file exists with another size
+int sim_flash_file(const char* path){
+    FILE* f = fopen(path, "rb");
+    sim.flash_file = path;
+    if (f) {
+        size_t n = fread(sim.flash, 1, sizeof(sim.flash), f);
+        fclose(f);
+        if (n != sizeof(sim.flash)) {
+            memset(sim.flash, 0xFF, sizeof(sim.flash));
+            sim.flash_file = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void flash_sync(void){
+    FILE* f;
+    if (sim.flash_file && (f = fopen(sim.flash_file, "wb"))) {
+        fwrite(sim.flash, 1, sizeof(sim.flash), f);
+        fclose(f);
+    }
+}
+
+// The CPU stalls while the flash is written: time moves on, the vectors due
+// meanwhile run at the end, the ADC halves they missed are lost
+static void flash_stall(unsigned long us){
+    unsigned long long cycles = (unsigned long long)us * (FCY / 1000000);
+    sim.stalled = 1;
+    run_until(sim.cycles + cycles, 0);
+    sim.stalled = 0;
+    sim.stall_cycles += cycles;
+    if (sim.t2_pending) {
+        sim.t2_pending = 0;
+        t2_vector();
+    }
+    if (sim.rx_irq_enabled)
+        rx_flush();
+    soft_irq_check();
+    if (!sim.in_isr)
+        tx_service();
+}
+
+// Count an operation: 1 if it reaches the flash in full, 0 if power is lost
+// during it (half of it is done), -1 if it comes after the loss
+static int flash_power(void){
+    sim.flash_ops++;
+    if (sim.flash_cut_at == 0 || sim.flash_ops < sim.flash_cut_at)
+        return 1;
+    return (sim.flash_ops == sim.flash_cut_at) ? 0 : -1;
+}
+
+void hal_flash_read(int page, unsigned int offset, void* data, unsigned int len){
+    memcpy(data, &sim.flash[page][offset], len);
+}
+
+int hal_flash_program(int page, unsigned int offset, const unsigned char data[HAL_FLASH_WORD]){
+    unsigned char* word = &sim.flash[page][offset];
+    int k, power = flash_power(), erased = 1;
+
+    if (power < 0)
+        return -1;
+    for (k = 0; k < HAL_FLASH_WORD; k++)
+        erased &= (word[k] == 0xFF);
+    sim.flash_errors += !erased;
+    for (k = 0; k < (power ? HAL_FLASH_WORD : HAL_FLASH_WORD / 2); k++)
+        word[k] &= data[k];
+    flash_sync();
+    flash_stall(HAL_FLASH_PROGRAM_US);
+    return power ? 0 : -1;
+}
+
+int hal_flash_erase(int page){
+    int power = flash_power();
+
+    if (power < 0)
+        return -1;
+    memset(sim.flash[page], 0xFF, power ? HAL_FLASH_PAGE_SIZE : HAL_FLASH_PAGE_SIZE / 2);
+    flash_sync();
+    flash_stall(HAL_FLASH_ERASE_US);
+    return power ? 0 : -1;
+}
@@ -0,0 +1,151 @@
+/*
+ * File:   hal_sim.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef HAL_SIM_H
+#define	HAL_SIM_H
+
+// Simulated register backend used by hal.h when HOST_BUILD is defined.
+// Time is counted in instruction cycles (Tcy at FCY) and only moves forward
+// when the firmware idles (hal_idle) or waits on a peripheral (UART TX FIFO,
+// Timer1 period), or when the host driver calls sim_advance() or sim_period().
+// Interrupt vectors (ADC, Timer1, Timer2, UART TX) run at their simulated time
+// while time moves forward, at their priority: the control job waits for the
+// priority to drop below IPL_CONTROL, the software interrupt of the command
+// job for it to drop below IPL_COMMANDS. The control job takes no simulated
+// time; each run of the command job takes command_cycles, spent before it
+// parses, during which the vectors and the control job preempt it, so the
+// command latency the firmware measures is not 0. host/exec_model.c models
+// the cost of every job.
+// The data flash is an array, optionally backed by a file, where programming
+// only clears bits; flash_cut_at emulates a power loss in the middle of a write.
+// Writing it stalls the CPU for the flash time: vectors wait for the end, the
+// UART keeps receiving into its 4 byte FIFO and overflows.
+
+// Cost of the command job, parse, apply and ack of a command (the estimates
+// of host/exec_model.c)
+#define SIM_COMMAND_CYCLES 2000
+
+// GPIO lines
+enum {
+    SIM_LED_A0,
+    SIM_LEFT,
+    SIM_RIGHT,
+    SIM_BEAM,
+    SIM_BRAKES,
+    SIM_LOW,
+    SIM_IR_ENABLE,
+    SIM_BUTTON,
+    SIM_GPIO_COUNT
+};
+
+// Simulated timer (TCKPS, PRx, TON and TxIF)
+typedef struct {
+    int on;
+    int tckps;
+    unsigned long period;      // Counts - 1
+    unsigned long long next;   // Cycle at which the period expires next
+    int flag;
+    int polled;                // Polled since the last clear
+} sim_timer;
+
+// Simulated machine state
+typedef struct {
+    unsigned long long cycles;       // Cycles since reset
+    unsigned long long idle_cycles;  // Cycles spent in hal_idle() or waiting for Timer1
+    unsigned long long spin_cycles;  // Cycles spent busy-waiting on the UART
+    unsigned long overruns;          // Timer1 periods already expired when the wait began
+
+    volatile unsigned char gpio[SIM_GPIO_COUNT];
+    volatile unsigned int oc_r[4];
+    volatile unsigned int oc_rs[4];
+    unsigned long oc_writes;         // OCxR written by hal_oc_write()
+    unsigned long oc_overlaps;       // Writes leaving both channels of a wheel on
+    unsigned int adc[2];             // Codes converted by the next ADC interrupt
+    int adc_noise;                   // Uniform noise added to the IR codes, +- codes
+    unsigned long noise_seed;
+    int adc_on;
+    unsigned long long adc_next;     // Cycle of the next ADC interrupt
+    sim_timer timer[8];              // Indexed by TIMER1..TIMER45 (header.h), a pair is one timer
+
+    int ipl;                         // CPU priority
+    int int1_enabled;
+    int t1_irq_enabled;
+    int t1_pending;                  // Timer1 expired while the control job was masked
+    int t2_irq_enabled;
+    int soft_irq_enabled;            // INT2, the command job
+    int soft_pending;
+    unsigned long command_cycles;    // Cost of a run of the command job (SIM_COMMAND_CYCLES)
+    int rx_irq_enabled;
+    int tx_irq_enabled;
+    int in_isr;                      // Nesting depth of simulated interrupt handlers
+    char rx_pending[4];              // UART RX FIFO while the RX interrupt is masked
+    int rx_count;
+    int rx_oerr;                     // FIFO overflowed: nothing is received until cleared
+    unsigned long rx_lost;           // Bytes lost to overruns
+    unsigned long rx_overruns;       // Overruns cleared by the RX vector
+    char rx_line[256];               // Bytes on their way at the baud rate (sim_uart_send)
+    int rx_line_head;
+    int rx_line_count;
+    unsigned long long rx_line_next; // Cycle at which the next of them is received
+
+    long baud;
+    unsigned long long tx_free_at;   // Cycle at which the TX shift register empties
+    unsigned long tx_bytes;
+    void (*tx_sink)(char data);      // Optional observer for transmitted bytes
+
+    unsigned char flash[HAL_FLASH_PAGES][HAL_FLASH_PAGE_SIZE];
+    const char* flash_file;          // Image the flash is kept in across runs (sim_flash_file)
+    unsigned long flash_ops;         // Program and erase operations
+    unsigned long flash_cut_at;      // Power lost during this operation (0: never): it is left
+                                     // half done and the later ones do not reach the flash
+    unsigned long flash_errors;      // Double words programmed again without an erase
+    int stalled;                     // Flash being written: the CPU and its vectors stop
+    int t2_pending;                  // Timer2 expired during a stall
+    unsigned long long stall_cycles; // Cycles spent stalled
+} sim_machine;
+
+extern sim_machine sim;
+
+#define HAL_GPIO_LED_A0    sim.gpio[SIM_LED_A0]
+#define HAL_GPIO_LEFT      sim.gpio[SIM_LEFT]
+#define HAL_GPIO_RIGHT     sim.gpio[SIM_RIGHT]
+#define HAL_GPIO_BEAM      sim.gpio[SIM_BEAM]
+#define HAL_GPIO_BRAKES    sim.gpio[SIM_BRAKES]
+#define HAL_GPIO_LOW       sim.gpio[SIM_LOW]
+#define HAL_GPIO_IR_ENABLE sim.gpio[SIM_IR_ENABLE]
+#define HAL_GPIO_BUTTON    sim.gpio[SIM_BUTTON]
+
+#define HAL_OC1R  sim.oc_r[0]
+#define HAL_OC2R  sim.oc_r[1]
+#define HAL_OC3R  sim.oc_r[2]
+#define HAL_OC4R  sim.oc_r[3]
+#define HAL_OC1RS sim.oc_rs[0]
+#define HAL_OC2RS sim.oc_rs[1]
+#define HAL_OC3RS sim.oc_rs[2]
+#define HAL_OC4RS sim.oc_rs[3]
+
+// DSP accumulator A as set up by hal_board_init: fractional MAC into a 40 bit
+// accumulator, conventional rounding and saturation of SAC.R; LAC32 and SAC32
+// load and store bits 31..0 (int is the 32 bits of the dsPIC long)
+typedef long long sim_acc;
+#define HAL_ACC_DECLARE(a)   sim_acc a
+#define HAL_ACC_CLR(a)       (a = 0)
+#define HAL_ACC_LAC(a, v)    (a = (sim_acc)(short)(v) * 65536)
+#define HAL_ACC_LAC32(a, v)  (a = (sim_acc)(int)(v))
+#define HAL_ACC_MAC(a, x, y) (a += (sim_acc)(short)(x) * (short)(y) * 2)
+#define HAL_ACC_SACR(a)      sim_sacr(a)
+#define HAL_ACC_SAC32(a)     ((long)(int)(a))
+int sim_sacr(sim_acc a);
+
+// Host driver functions
+void sim_reset(void);
+void sim_advance(unsigned long long cycles);
+void sim_period(void);
+void sim_uart_receive(char data);
+int sim_uart_send(const char* data, int len);
+void sim_button(int pressed);
+int sim_flash_file(const char* path);
+
+#endif	/* HAL_SIM_H */
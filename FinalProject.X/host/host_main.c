@@ -0,0 +1,201 @@
+/*
+ * File:   host_main.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Host driver for the firmware: runs sim_period() against the simulated
+// HAL and reports the wall-clock cost of each 1 kHz loop iteration together
+// with the simulated Timer1 overruns. Exits with 1 when the mean iteration
+// cost exceeds the budget given with -B, so timing regressions can be caught
+// by scripts. With -c a command is received on UART2 as a single burst at
+// every -p iterations, to measure how long commands wait to be applied.
+// With -N the IR codes get uniform noise of +-N codes, the spread of the
+// filtered codes shows what the ADC filters leave of it. -T saves the trace
+// recorded from boot and -O the output log (host/outlog.h, the $MPERF task
+// is then off), host/replay runs the trace again and checks that it gives
+// the same log. -F keeps the data flash in a file, so the configuration
+// saved by a run is loaded by the next one.
+//
+// Usage: firmware_host [-n iterations] [-i ir_code] [-b battery_code]
+//                      [-m] [-u] [-B budget_ns] [-c command] [-p period]
+//                      [-N noise] [-T trace.bin] [-O outputs.txt] [-F flash.bin]
+
+#include "hal.h"
+#include "header.h"
+#include "outlog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int echo_uart;
+
+static void print_tx(char data){
+    if (echo_uart)
+        putchar(data);
+    outlog_tx(data);
+}
+
+static long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void* a, const void* b){
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv){
+    long iterations = 10000;
+    unsigned int ir_code = 400, battery_code = 500;
+    int moving = 0, opt;
+    long long budget_ns = 0;
+    const char* command = NULL;
+    long command_period = 100;
+    int noise = 0;
+    unsigned int ir_min = 1023, ir_max = 0;
+    const char* trace_file = NULL;
+    FILE* outputs = NULL;
+    const char* flash_file = NULL;
+
+    while ((opt = getopt(argc, argv, "n:i:b:muB:c:p:N:T:O:F:")) != -1) {
+        switch (opt) {
+            case 'n': iterations = atol(optarg); break;
+            case 'i': ir_code = atoi(optarg); break;
+            case 'b': battery_code = atoi(optarg); break;
+            case 'm': moving = 1; break;
+            case 'u': echo_uart = 1; break;
+            case 'B': budget_ns = atoll(optarg); break;
+            case 'c': command = optarg; break;
+            case 'p': command_period = atol(optarg); break;
+            case 'N': noise = atoi(optarg); break;
+            case 'T': trace_file = optarg; break;
+            case 'F': flash_file = optarg; break;
+            case 'O':
+                if ((outputs = fopen(optarg, "w")) == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-i ir_code] [-b battery_code] [-m] [-u] [-B budget_ns] [-c command] [-p period] [-N noise] [-T trace.bin] [-O outputs.txt] [-F flash.bin]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (iterations <= 0)
+        iterations = 1;
+    if (command_period <= 0)
+        command_period = 1;
+
+    sim_reset();
+    sim.tx_sink = print_tx;
+    outlog_open(outputs);
+    sim.adc[ADC_IR] = ir_code;
+    sim.adc[ADC_BATTERY] = battery_code;
+    sim.adc_noise = noise;
+    if (flash_file != NULL && sim_flash_file(flash_file) != 0) {
+        fprintf(stderr, "%s: not a flash image\n", flash_file);
+        return 2;
+    }
+
+    control_setup();
+    if (outputs != NULL)
+        outlog_no_perf();
+
+    long long* cost = malloc(iterations * sizeof(long long));
+    if (cost == NULL)
+        return 2;
+
+    long long total = 0;
+    long k;
+    for (k = 0; k < iterations; k++) {
+        // Press the button long enough for the 10 ms debounce to see it
+        if (moving && (k == 0 || k == 12))
+            sim_button(k == 0);
+        if (command != NULL && k % command_period == 0) {
+            const char* c;
+            for (c = command; *c != '\0'; c++)
+                sim_uart_receive(*c);
+        }
+        long long t0 = now_ns();
+        sim_period();
+        cost[k] = now_ns() - t0;
+        total += cost[k];
+        outlog_tick(k);
+        if (k >= 10) {  // Once the filters are full
+            if (loop_snapshot.sample.ir < ir_min)
+                ir_min = loop_snapshot.sample.ir;
+            if (loop_snapshot.sample.ir > ir_max)
+                ir_max = loop_snapshot.sample.ir;
+        }
+    }
+
+    qsort(cost, iterations, sizeof(long long), cmp_ll);
+    long long mean = total / iterations;
+    double sim_s = (double)sim.cycles / FCY;
+
+    fprintf(stderr, "iterations      %ld\n", iterations);
+    fprintf(stderr, "ns/iteration    min %lld  mean %lld  p99 %lld  max %lld\n",
+            cost[0], mean, cost[(iterations * 99) / 100], cost[iterations - 1]);
+    fprintf(stderr, "simulated time  %.3f s\n", sim_s);
+    fprintf(stderr, "idle cycles     %.1f %%\n", 100.0 * sim.idle_cycles / sim.cycles);
+    fprintf(stderr, "cpu load        %u.%u %% of the last second (host cost of the work)\n",
+            cpu_load / 10, cpu_load % 10);
+    fprintf(stderr, "spin cycles     %.1f %%\n", 100.0 * sim.spin_cycles / sim.cycles);
+    fprintf(stderr, "t1 overruns     %lu\n", sim.overruns);
+    fprintf(stderr, "oc writes       %lu (%.3f per period)  overlaps %lu\n",
+            sim.oc_writes, (double)sim.oc_writes / iterations, sim.oc_overlaps);
+    fprintf(stderr, "config          %s (record %u)  saved %u  flash ops %lu  stalled %.1f ms\n",
+            config_loaded ? "loaded" : "defaults", config_seq, config_saves, sim.flash_ops,
+            sim.stall_cycles * 1e3 / FCY);
+    fprintf(stderr, "uart tx bytes   %lu (%.1f B/s)\n", sim.tx_bytes, sim.tx_bytes / sim_s);
+    fprintf(stderr, "ir filtered     min %u  max %u  (input %u +- %d)  lost %u\n",
+            ir_min, ir_max, ir_code, noise, adcr.lost);
+    fprintf(stderr, "rx buffer       high water %u/%d  dropped %u  overruns %u\n",
+            cb.high_water, BUFFER_SIZE, cb.dropped, hal_uart_rx_overruns());
+#if PERF_PROBES
+    static const char* const stages[PERF_STAGES] = { "adc", "rx", "state", "pwm", "sched", "loop" };
+    fprintf(stderr, "stage   min cyc   max cyc  histogram (<1k <2k <4k <8k <16k <32k <64k more)\n");
+    for (k = 0; k < PERF_STAGES; k++) {
+        int b;
+        fprintf(stderr, "%-6s %8lu %9lu ", stages[k], perf[k].max ? perf[k].min : 0, perf[k].max);
+        for (b = 0; b < PERF_BINS; b++)
+            fprintf(stderr, " %u", perf[k].hist[b]);
+        fputc('\n', stderr);
+    }
+#endif
+    fprintf(stderr, "missed deadlines %u\n", perf_overruns);
+    for (k = 0; k < MAX_TASKS; k++) {
+        const heartbeat* t = &schedInfo[k];
+        if (t->runs > 0)
+            fprintf(stderr, "task %ld          runs %u  late min %u us  max %u us  jitter %u us\n",
+                    k, t->runs, t->late_min_us, t->late_max_us, t->late_max_us - t->late_min_us);
+    }
+    if (cmd_stats.count > 0)
+        fprintf(stderr, "cmd latency     count %u  mean %lu us  max %lu us\n",
+                cmd_stats.count, cmd_stats.sum_us / cmd_stats.count, cmd_stats.max_us);
+    fprintf(stderr, "tx queue        high water %u/%d  dropped %u\n", txq.high_water, TX_BUFFER_SIZE, txq.dropped);
+    free(cost);
+    if (outputs != NULL)
+        fclose(outputs);
+#if TRACE_ENABLE
+    if (trace_file != NULL) {
+        FILE* f = fopen(trace_file, "wb");
+        if (f == NULL || fwrite(trace.data, 1, trace.len, f) != trace.len) {
+            perror(trace_file);
+            return 1;
+        }
+        fclose(f);
+        fprintf(stderr, "trace           %u/%d bytes%s\n", trace.len, TRACE_SIZE, trace.full ? " (full)" : "");
+    }
+#endif
+
+    if (budget_ns > 0 && mean > budget_ns) {
+        fprintf(stderr, "FAIL: mean %lld ns exceeds budget %lld ns\n", mean, budget_ns);
+        return 1;
+    }
+    return 0;
+}
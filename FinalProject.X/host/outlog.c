@@ -0,0 +1,75 @@
+/*
+ * File:   outlog.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include "outlog.h"
+#include <string.h>
+
+static FILE* out;
+static unsigned long current;              // Iteration the bytes are sent in
+static unsigned int oc[4];
+static unsigned char gpio[SIM_GPIO_COUNT];
+static unsigned char msg[256];
+static int len;
+
+void outlog_open(FILE* f){
+    int k;
+    out = f;
+    current = 0;
+    len = 0;
+    // Everything is logged at the first iteration
+    for (k = 0; k < 4; k++)
+        oc[k] = ~0U;
+    memset(gpio, 0xFF, sizeof(gpio));
+}
+
+void outlog_no_perf(void){
+    int k;
+    for (k = 0; k < MAX_TASKS; k++)
+        if (schedInfo[k].f == task_send_perf)
+            schedInfo[k].enable = 0;
+}
+
+void outlog_tick(unsigned long tick){
+    int k;
+
+    if (out == NULL)
+        return;
+    if (memcmp(oc, (const void*)sim.oc_r, sizeof(oc)) != 0) {
+        memcpy(oc, (const void*)sim.oc_r, sizeof(oc));
+        fprintf(out, "%lu oc %u %u %u %u\n", tick, oc[0], oc[1], oc[2], oc[3]);
+    }
+    // Outputs only, the button is an input
+    for (k = SIM_LED_A0; k <= SIM_IR_ENABLE; k++) {
+        if (gpio[k] != sim.gpio[k]) {
+            gpio[k] = sim.gpio[k];
+            fprintf(out, "%lu gpio %d %u\n", tick, k, gpio[k]);
+        }
+    }
+    current = tick + 1;
+}
+
+// Messages end at '\n' ($ASCII) or at the 0x00 delimiter (binary frames)
+void outlog_tx(char data){
+    int k;
+
+    if (len < (int)sizeof(msg))
+        msg[len++] = data;
+    if (msg[0] == '$' ? data != '\n' : data != 0)
+        return;
+    if (out != NULL) {
+        if (msg[0] == '$') {
+            fprintf(out, "%lu tx ", current);
+            fwrite(msg, 1, len, out);
+        } else {
+            fprintf(out, "%lu frame", current);
+            for (k = 0; k < len; k++)
+                fprintf(out, " %02x", msg[k]);
+            fputc('\n', out);
+        }
+    }
+    len = 0;
+}
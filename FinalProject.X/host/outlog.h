@@ -0,0 +1,24 @@
+/*
+ * File:   outlog.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef OUTLOG_H
+#define	OUTLOG_H
+
+#include <stdio.h>
+
+// Log of what the firmware drives, one line per change: the OCxR compare
+// values and the output GPIOs after each loop iteration, the UART output as
+// whole messages (ASCII text or binary frames in hex). Two runs of the
+// firmware on the same inputs produce the same log, host/replay compares
+// them, provided the $MPERF task is off: its cycle counts follow the host
+// clock and the length of its messages shifts the ones queued after them.
+
+void outlog_no_perf(void);              // Disable the $MPERF task
+
+void outlog_open(FILE* f);
+void outlog_tick(unsigned long tick);   // After each control loop iteration
+void outlog_tx(char data);              // sim.tx_sink
+
+#endif	/* OUTLOG_H */
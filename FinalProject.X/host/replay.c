@@ -0,0 +1,222 @@
+/*
+ * File:   replay.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Replay of a control loop trace (trace.c) on the host: the firmware runs
+// against the simulated HAL, each iteration gets the ADC codes, the UART
+// bytes and the button state changes recorded on the buggy, and what it
+// drives is written as an output log (host/outlog.h). With -e the log is
+// compared with the expected one, e.g. from firmware_host -T trace.bin -O
+// expected.txt, and the first difference is reported. The trace comes from
+// firmware_host or from the buggy: $PTRC,2* then telemetry_decode -t.
+// The trace starts with the configuration the firmware ran, e.g. the one it
+// loaded from the flash, and the replay applies it before the first
+// iteration. Only a trace recorded from boot starts from the same firmware
+// state; a later one ($PTRC,1*) runs from a fresh one and may diverge.
+//
+// Usage: replay [-n ticks] [-o outputs.txt] [-e expected.txt] trace.bin
+// -n runs ticks iterations in all, by default up to the last event.
+
+#include "hal.h"
+#include "header.h"
+#include "outlog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned char data[TRACE_SIZE];
+static unsigned int len, pos;
+
+static unsigned long get32(const unsigned char* p){
+    return p[0] | p[1] << 8 | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+// Tick of the next event, or 0 at the end of the trace. prev is the tick of
+// the previous event
+static int next_event(unsigned long prev, unsigned long* tick){
+    int delta;
+
+    if (pos >= len)
+        return 0;
+    delta = data[pos] & TRACE_DELTA_ESC;
+    if (delta == TRACE_DELTA_ESC) {
+        if (pos + 5 > len)
+            return 0;
+        *tick = prev + get32(data + pos + 1);
+    } else {
+        *tick = prev + delta;
+    }
+    return 1;
+}
+
+// Apply the event at pos to the inputs of the iteration, returns 0 if it is
+// not valid
+static int apply_event(AdcSample* sample){
+    int type = data[pos] >> 5;
+    unsigned int p = pos + 1 + ((data[pos] & TRACE_DELTA_ESC) == TRACE_DELTA_ESC ? 4 : 0);
+    static const int payload[] = {3, 1, 1, 1, CONFIG_PAYLOAD};
+
+    if (type > TRACE_EV_CONFIG || p + payload[type] > len)
+        return 0;
+    switch (type) {
+        case TRACE_EV_ADC: {
+            unsigned long codes = data[p] | data[p + 1] << 8 | (unsigned long)data[p + 2] << 16;
+            sample->battery = codes & 0x3FF;
+            sample->ir = (codes >> 10) & 0x3FF;
+            break;
+        }
+        case TRACE_EV_ADC_DELTA:
+            // Sign extension of the nibbles
+            sample->battery += ((data[p] >> 4) ^ 8) - 8;
+            sample->ir += ((data[p] & 0xF) ^ 8) - 8;
+            break;
+        case TRACE_EV_RX:
+            isr_uart_rx(data[p]);
+            break;
+        case TRACE_EV_STATE:
+            control_data.state = data[p];
+            break;
+        case TRACE_EV_CONFIG:
+            config_apply(data + p);
+            outlog_no_perf();
+            break;
+    }
+    pos = p + payload[type];
+    return 1;
+}
+
+static FILE* open_file(const char* name, const char* mode){
+    FILE* f = fopen(name, mode);
+    if (f == NULL) {
+        perror(name);
+        exit(1);
+    }
+    return f;
+}
+
+static long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Compare two output logs up to the given tick, reporting the first
+// difference. Returns 1 if they match
+static int compare(FILE* got, FILE* expected, unsigned long last){
+    char a[512], b[512];
+    int line = 0;
+
+    rewind(got);
+    for (;;) {
+        char* ra = fgets(a, sizeof(a), got);
+        char* rb = fgets(b, sizeof(b), expected);
+        line++;
+        // Lines after the end of the replay are not compared
+        if (rb != NULL && strtoul(b, NULL, 10) > last)
+            rb = NULL;
+        if (ra != NULL && strtoul(a, NULL, 10) > last)
+            ra = NULL;
+        if (ra == NULL && rb == NULL)
+            return 1;
+        if (ra == NULL || rb == NULL || strcmp(a, b) != 0) {
+            fprintf(stderr, "MISMATCH at line %d\n  replay:   %s  expected: %s", line,
+                    ra ? a : "(end)\n", rb ? b : "(end)\n");
+            return 0;
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    const char* out_file = NULL;
+    const char* expected_file = NULL;
+    long ticks = -1;
+    unsigned long start, tick, event = 0, k, events = 0;
+    int opt, have_event;
+    AdcSample sample = {0, 0};
+    FILE* f;
+    FILE* out;
+
+    while ((opt = getopt(argc, argv, "n:o:e:")) != -1) {
+        switch (opt) {
+            case 'n': ticks = atol(optarg); break;
+            case 'o': out_file = optarg; break;
+            case 'e': expected_file = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-n ticks] [-o outputs.txt] [-e expected.txt] trace.bin\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-n ticks] [-o outputs.txt] [-e expected.txt] trace.bin\n", argv[0]);
+        return 2;
+    }
+
+    f = open_file(argv[optind], "rb");
+    len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+    if (len < TRACE_HEADER_LEN || data[0] != 'T' || data[1] != 'R' || data[2] != TRACE_VERSION) {
+        fprintf(stderr, "%s: not a version %d trace\n", argv[optind], TRACE_VERSION);
+        return 1;
+    }
+    if (!(data[3] & TRACE_FROM_BOOT))
+        fprintf(stderr, "warning: the trace was not recorded from boot, the replay may diverge\n");
+    start = tick = get32(data + 4);
+    pos = TRACE_HEADER_LEN;
+
+    out = out_file ? open_file(out_file, "w+") : tmpfile();
+    sim_reset();
+    sim.tx_sink = outlog_tx;
+    outlog_open(out);
+    control_setup();
+    trace.mode = TRACE_OFF;   // The replay does not record itself
+    outlog_no_perf();
+    // The replay runs the control job itself, with the recorded codes
+    hal_timer_irq(TIMER1, 0);
+
+    long long t0 = now_ns();
+    have_event = next_event(tick, &event);
+    for (k = 0; ticks < 0 ? have_event : (long)k < ticks; k++) {
+        // Inputs of the iteration, received while idle before it: the bytes run
+        // the command job
+        while (have_event && event == start + k) {
+            if (!apply_event(&sample)) {
+                fprintf(stderr, "bad event at offset %u\n", pos);
+                return 1;
+            }
+            events++;
+            tick = event;
+            have_event = next_event(tick, &event);
+        }
+        // Up to the Timer1 period of the iteration, as sim_period()
+        sim_timer* t1 = &sim.timer[TIMER1];
+        sim.idle_cycles += t1->next - sim.cycles;
+        sim_advance(t1->next - sim.cycles);
+        hal_timer_clear(TIMER1);
+        
+        // Then the control job and the background tasks
+        PERF_BEGIN(PERF_LOOP);   // Ended by control_run, as in isr_control_period
+        control_run(&sample);
+        background_step();
+        outlog_tick(k);
+    }
+    long long elapsed = now_ns() - t0;
+    fflush(out);
+
+    fprintf(stderr, "replayed        %lu ticks, %lu events of %u bytes\n", k, events, len);
+    fprintf(stderr, "speed           %.0f ticks/s (%.0fx real time)\n",
+            k * 1e9 / elapsed, k * 1e9 / elapsed * LOOP_PERIOD_US / 1e6);
+    if (have_event)
+        fprintf(stderr, "warning: %u trace bytes after tick %lu not replayed\n", len - pos, start + k - 1);
+    if (expected_file != NULL) {
+        FILE* e = open_file(expected_file, "r");
+        if (k == 0 || !compare(out, e, k - 1))
+            return 1;
+        fprintf(stderr, "outputs match the expected log up to tick %lu\n", k - 1);
+        fclose(e);
+    }
+    fclose(out);
+    return 0;
+}
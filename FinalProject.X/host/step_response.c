@@ -0,0 +1,131 @@
+/*
+ * File:   step_response.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+// Step response of the surge control laws: the buggy starts -d cm away from a
+// wall and drives straight towards it at every 1 ms loop tick, the wall
+// being the setpoint at MINTH. The plant is a first order motor lag from the
+// surge command to the speed (VMAX at 100 %, time constant TAU) integrated
+// into the distance; the sensor adds uniform noise of +-s cm and quantizes
+// to the 1/16 cm of the firmware. Each law is run on the same plant and
+// scored on settling time (within BAND of MINTH for good), overshoot past
+// MINTH, final error and surge chatter (sum of the surge changes once in
+// the band).
+//
+// Usage: step_response [-d start_cm] [-s noise_cm] [-t seconds] [-l law]
+//                      [-g kp,ki,kd] [-r period_ms]
+// -l runs a single law (0 proportional, 1 PID), -g sets the surge PID gains
+// in hundredths as $PPID does and -r its period as $PPIDR does.
+
+#include "hal.h"
+#include "header.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VMAX 50.0      // Speed at 100 % surge, cm/s
+#define TAU  0.15      // Motor time constant, s
+#define BAND 1.0       // Settling band around MINTH, cm
+#define DT   (LOOP_PERIOD_US / 1e6)
+#define GAIN(q8) ((double)(q8) / (1 << PID_GAIN_BITS))
+
+typedef struct {
+    double settle_s;     // Last time out of the band, -1 if never settled
+    double overshoot;    // cm past MINTH
+    double final_error;  // cm from MINTH at the end
+    long chatter;        // Sum of the surge changes in the band, %
+    double ns_per_step;  // Host cost of the control law
+} response;
+
+static long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static response run(int law, double start, double noise, double seconds){
+    ControlData d = {25, 50, 0, 0, Moving, SURGE_GAIN, YAW_SCALE, law};
+    long steps = seconds / DT, k;
+    double dist = start, v = 0, closest = start;
+    long long cost = 0;
+    int prev_surge = 0, in_band = 0;
+    response r = {0, 0, 0, 0, 0};
+
+    srand(1);
+    control_pid_reset();
+    for (k = 0; k < steps; k++) {
+        double measured = dist + noise * (2.0 * rand() / RAND_MAX - 1);
+        int q = (int)lround(measured * DIST_ONE);
+        long long t0 = now_ns();
+        if (law == LAW_PID)
+            control_pid(&d, q < 0 ? 0 : q);
+        else
+            control_law(&d, q < 0 ? 0 : q);
+        cost += now_ns() - t0;
+
+        v += (VMAX * d.surge / 100 - v) * DT / TAU;
+        dist -= v * DT;
+        if (dist < closest)
+            closest = dist;
+
+        if (fabs(dist - d.MINTH) > BAND) {
+            r.settle_s = (k + 1) * DT;
+            in_band = 0;
+        } else {
+            if (in_band)
+                r.chatter += abs(d.surge - prev_surge);
+            in_band = 1;
+        }
+        prev_surge = d.surge;
+    }
+    if (fabs(dist - d.MINTH) > BAND)
+        r.settle_s = -1;
+    r.overshoot = (closest < d.MINTH) ? d.MINTH - closest : 0;
+    r.final_error = dist - d.MINTH;
+    r.ns_per_step = (double)cost / steps;
+    return r;
+}
+
+int main(int argc, char** argv){
+    double start = 100, noise = 0, seconds = 10;
+    int law = -1, opt, l;
+    int kp = -1, ki = 0, kd = 0, period = PID_PERIOD_MS;
+    static const char* const names[] = {"proportional", "pid"};
+
+    while ((opt = getopt(argc, argv, "d:s:t:l:g:r:")) != -1) {
+        switch (opt) {
+            case 'd': start = atof(optarg); break;
+            case 's': noise = atof(optarg); break;
+            case 't': seconds = atof(optarg); break;
+            case 'l': law = atoi(optarg); break;
+            case 'g': sscanf(optarg, "%d,%d,%d", &kp, &ki, &kd); break;
+            case 'r': period = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-d start_cm] [-s noise_cm] [-t seconds] [-l law] [-g kp,ki,kd] [-r period_ms]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    control_pid_init();
+    if (kp >= 0)
+        pid_gains(&pid_surge, PID_GAIN_Q8(kp), PID_GAIN_Q8(ki), PID_GAIN_Q8(kd), period);
+    control_pid_rate(period);
+
+    printf("start %.1f cm, noise +-%.2f cm, %.1f s, surge PID %.2f,%.2f,%.2f every %d ms\n",
+           start, noise, seconds, GAIN(pid_surge.kp), GAIN(pid_surge.ki), GAIN(pid_surge.kd), period);
+    printf("%-14s %10s %12s %12s %10s %10s\n", "law", "settle s", "overshoot cm", "final cm", "chatter %", "ns/step");
+    for (l = LAW_PROPORTIONAL; l <= LAW_PID; l++) {
+        if (law >= 0 && law != l)
+            continue;
+        response r = run(l, start, noise, seconds);
+        if (r.settle_s < 0)
+            printf("%-14s %10s", names[l], "never");
+        else
+            printf("%-14s %10.3f", names[l], r.settle_s);
+        printf(" %12.2f %12.2f %10ld %10.1f\n", r.overshoot, r.final_error, r.chatter, r.ns_per_step);
+    }
+    return 0;
+}
@@ -1,188 +1,327 @@
-/*
- * File:   main.c
- * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
- */
-
-#include "xc.h"
-#include "header.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <math.h>
-
-volatile ControlData control_data = {25, 50, 0, 0, WaitForStart};
-volatile CircularBuffer cb;
-
-// Interrupt Service Routine for INT1 
-void __attribute__((__interrupt__,__auto_psv__)) _INT1Interrupt(){  
-    IFS1bits.INT1IF = 0;      
-    IEC1bits.INT1IE = 0; 
-    tmr_setup_period(TIMER2, 10);   
-}
-
-// Interrupt Service Routine for Timer2
-void __attribute__((__interrupt__,__auto_psv__)) _T2Interrupt(){
-    IFS0bits.T2IF = 0;  
-    T2CONbits.TON = 0;   
-    
-    // Toggle the state based on RE8 button
-    if(PORTEbits.RE8 == 1){
-        // If the current state is WaitForStart, set it to Moving; otherwise, set it back to WaitForStart
-        control_data.state = (control_data.state == WaitForStart) ? Moving : WaitForStart;
-    }
-    
-    IEC1bits.INT1IE = 1; 
-}
-
-// Interrupt handler for the char recevied on UART2
-void __attribute__((__interrupt__, __auto_psv__)) _U2RXInterrupt() {
-    IFS1bits.U2RXIF = 0;         // Reset UART2 Receiver Interrupt Flag Status bit
-    char receivedChar = U2RXREG; // Get char from UART2 received REG
-    cb_push(&cb, receivedChar);  // Push it to the circular buffer  
-}
-
-int main(void) {
-    // Disable analog inputs
-    ANSELA = ANSELB = ANSELC = ANSELD = ANSELE = ANSELG = 0x0000;
-    
-    // Set up peripherals
-    LigthsSetup();
-    PWMsetup(10000);  // Set up PWM at 10kHz
-    ADCsetup();
-    UARTsetup();
-    
-    char readChar;     // Keep track of the received characters
-    int i = 0;         // For reading payloads from parser
-    
-    // Initialize CircularBuffer
-    cb.head = 0;
-    cb.tail = 0; 
-    cb.to_read = 0;
-    
-    // Initialize ParserState
-    parser_state pstate = {
-        .state = STATE_DOLLAR,
-        .index_type = 0,
-        .index_payload = 0
-    };
-    
-    // Configure INT1 (mapped to RE8)
-    TRISEbits.TRISE8 = 1;     // Set RE8 as input
-    RPINR0bits.INT1R = 0x58;  // Remap RE8 to INT1 (RPI88 -> 0x58)
-    INTCON2bits.GIE = 1;      // Enable global interrupts
-    IFS1bits.INT1IF = 0;      // Clear INT1 interrupt flag
-    
-    // Enable Interrupts
-    IEC1bits.INT1IE = 1;      // Enable INT1 interrupt
-    IEC0bits.T2IE = 1;        // Enable Timer2 Interrupt 
-    IEC1bits.U2RXIE = 1;      // enable interrupt for UART    
-     
-    // Scheduler configuration
-    heartbeat schedInfo[MAX_TASKS] = {
-        // LedA0 Blinking Task
-        { .n = 0, .N = 1000, .f = task_blinkA0, .params = NULL, .enable = 1 },
-        
-        // Left and Right Indicators Blinking Task
-        { .n = 0, .N = 1000, .f = task_blink_indicators, .params = &control_data, .enable = 1 },
-        
-        // Send Battery Task
-        { .n = 0, .N = 1000, .f = task_send_battery, .params = NULL, .enable = 1 },
-        
-        // Send Distance Task
-        { .n = 0, .N = 10000, .f = task_send_distance, .params = NULL, .enable = 1 },
-        
-        // Send Duty Cycle Task
-        { .n = 0, .N = 10000, .f = task_send_dutycycle, .params = NULL, .enable = 1 }
-    };
-    
-    // Control loop frequency = 1 kHz (1 ms period)
-    tmr_setup_period(TIMER1, 1); 
-    
-    while(1) {             
-        // ADC sampling
-        do{
-            if (AD1CON1bits.SAMP == 0)
-                AD1CON1bits.SAMP = 1;      // Start sampling
-        } while(!AD1CON1bits.DONE);        // Wait for sampling completion
-        
-        float distance = getMeasurements(DISTANCE);
-        
-        if (cb.to_read > 0) {          
-            IEC1bits.U2RXIE = 0;                // Disable UART2 Receiver Interrupt
-            int read = cb_pop(&cb, &readChar);  // Pop data from buffer
-            IEC1bits.U2RXIE = 1;                // Enable UART2 Receiver Interrupt
-
-            if (read == 1) {  
-                while (U2STAbits.UTXBF == 1); // Wait until the Transmit Buffer is not full 
-                                
-                int ret = parse_byte(&pstate, readChar);
-                if (ret == NEW_MESSAGE) {                    
-                    if (strcmp(pstate.msg_type, "PCTH") == 0) { 
-                        control_data.MINTH = extract_integer(pstate.msg_payload);
-                        i = next_value(pstate.msg_payload, i);
-                        control_data.MAXTH = extract_integer(pstate.msg_payload + i); 
-                        // Optionally send confirmation over UART
-                        //send_uart("OK");                           
-                    } else {
-                        // Optionally send error over UART
-                        //send_uart("ERR");     
-                    }
-                }                
-            }
-        }
-        
-        // State machine handling
-        switch(control_data.state) {
-            case WaitForStart:
-                PWMstop();  // Stop motors when waiting for start
-                
-                // Reset the lights indicators
-                LATAbits.LATA7 = 0;  // Beam lights on
-                LATFbits.LATF0 = 0;  // Brakes off
-                LATGbits.LATG1 = 0;  // Low intensity lights off
-                break;
-            
-            case Moving:
-                if (distance < control_data.MINTH) {
-                    control_data.surge = 0;
-                    control_data.yaw_rate = 100;
-                } else if (distance > control_data.MAXTH) {
-                    control_data.surge = 100;
-                    control_data.yaw_rate = 0;
-                } else {
-                    // Proportional control parameters
-                    const int surgeGain = 2, yawScale = 500;
-
-                    control_data.surge = distance * surgeGain; 
-                    control_data.yaw_rate = yawScale / distance;
-                }
-                
-                // Lights control
-                if (control_data.surge > 50) {
-                    LATAbits.LATA7 = 1;  // Beam lights on
-                    LATFbits.LATF0 = 0;  // Brakes off
-                    LATGbits.LATG1 = 0;  // Low intensity lights off
-                } else {
-                    LATAbits.LATA7 = 0;  // Beam lights off
-                    LATFbits.LATF0 = 1;  // Brakes on
-                    LATGbits.LATG1 = 1;  // Low intensity lights on
-                }
-                
-                if (control_data.yaw_rate > 15) {
-                    LATBbits.LATB8 = 0;  // Left indicator off
-                } else {
-                    LATBbits.LATB8 = 0;  // Left indicator off
-                    LATFbits.LATF1 = 0;  // Right indicator off
-                }
-                
-                // Set PWM duty cycle based on surge and yaw rate
-                PWMstart(&control_data);
-                break;
-        }
-        
-        scheduler(schedInfo, MAX_TASKS);       
-        tmr_wait_period(TIMER1);
-    }
-    
-    return 0;
-}
+/*
+ * File:   main.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+volatile ControlData control_data = {25, 50, 0, 0, WaitForStart, SURGE_GAIN, YAW_SCALE, LAW_PROPORTIONAL};
+volatile CircularBuffer cb;
+
+static parser_state pstate;  // Parser of the commands received on UART2
+
+static unsigned long ticks = -1;           // Control period, the first is 0
+static unsigned long rx_stamp[BUFFER_SIZE]; // Arrival time of the bytes in cb
+static unsigned long rx_last_us;            // Arrival time of the last byte, dropped or not
+static State last_state = WaitForStart;    // State of the previous iteration
+CommandStats cmd_stats;
+LoopSnapshot loop_snapshot;
+
+// Scheduler configuration: tasks with the same period have different phases,
+// so that no two tasks are released on the same tick
+heartbeat schedInfo[MAX_TASKS] = {
+    // LedA0 Blinking Task
+    { .N = LOOP_TICKS_MS(1000), .phase = 0, .f = task_blinkA0, .params = NULL, .enable = 1 },
+    
+    // Left and Right Indicators Blinking Task
+    { .N = LOOP_TICKS_MS(1000), .phase = 1, .f = task_blink_indicators, .params = (void*)&control_data, .enable = 1 },
+    
+    // Send Telemetry Snapshot Task
+    { .N = LOOP_TICKS_MS(1000), .phase = 2, .f = task_send_telemetry, .params = NULL, .enable = 1 },
+    
+    // Send Control Loop Timing Task, one stage per second
+    { .N = LOOP_TICKS_MS(1000), .phase = 3, .f = task_send_perf, .params = NULL, .enable = 1 },
+
+    // Save Configuration Task, when it changed
+    { .N = LOOP_TICKS_MS(1000), .phase = 4, .f = task_save_config, .params = NULL, .enable = 1 }
+};
+
+// INT1 (RE8 button): debounce it with a 10 ms one-shot on Timer2
+void isr_button_pressed(void){
+    TMR_SETUP_US(TIMER2, 10000);
+}
+
+// Timer2 elapsed: the button is still pressed after the debounce period
+void isr_debounce_elapsed(void){
+    // Toggle the state based on RE8 button
+    if(hal_gpio_read(BUTTON) == 1){
+        // If the current state is WaitForStart, set it to Moving; otherwise, set it back to WaitForStart
+        control_data.state = (control_data.state == WaitForStart) ? Moving : WaitForStart;
+    }
+}
+
+// Char received on UART2
+void isr_uart_rx(char data){
+    rx_last_us = loop_time_us();
+    // Timestamp the slot first, unless the buffer is full and the slot is still unread
+    if (cb_pending(&cb) < BUFFER_SIZE)
+        rx_stamp[cb.head & (BUFFER_SIZE - 1)] = rx_last_us;
+    cb_push(&cb, data);  // Push it to the circular buffer
+    hal_soft_irq_post(); // The command job parses it
+}
+
+// Microseconds since the first control period, from the period count and
+// Timer1. Read with the control job masked, which updates the count; it is
+// a period behind while the job waits to start
+unsigned long loop_time_us(void){
+    int ipl = hal_ipl_raise(IPL_CONTROL);
+    unsigned long period = ticks;
+    unsigned long count = hal_timer_count(TIMER1);
+    hal_ipl_restore(ipl);
+    return period * LOOP_PERIOD_US + count * LOOP_PERIOD_US / (hal_timer_period(TIMER1) + 1UL);
+}
+
+// Microseconds since the last byte was received (since the first control
+// period if none was)
+unsigned long rx_quiet_us(void){
+    int ipl = hal_ipl_raise(IPL_DEVICE);
+    unsigned long last = rx_last_us;
+    hal_ipl_restore(ipl);
+    return loop_time_us() - last;
+}
+
+unsigned long loop_ticks(void){
+    int ipl = hal_ipl_raise(IPL_CONTROL);
+    unsigned long t = ticks;
+    hal_ipl_restore(ipl);
+    return t;
+}
+
+// Account the latency of a command whose last byte arrived at stamp.
+// loop_time_us() is a period behind while the control job waits to start,
+// so it can read before the stamp: that counts as no latency
+static void command_applied(unsigned long stamp){
+    long latency = (long)(loop_time_us() - stamp);
+    if (latency < 0)
+        latency = 0;
+    cmd_stats.count++;
+    cmd_stats.last_us = latency;
+    cmd_stats.sum_us += latency;
+    if (latency > cmd_stats.max_us)
+        cmd_stats.max_us = latency;
+}
+
+// CPU load: idle cycles counted over windows of one second
+static unsigned long load_start;   // hal_cycles() at the start of the window
+static unsigned long load_idle;    // Idle cycles in the window
+unsigned int cpu_load;             // Per mille, of the last complete window
+unsigned long cpu_idle_cycles;     // Idle cycles of the last complete window
+
+// Set up peripherals, buffers and the 1 kHz control loop timer
+void control_setup(void){
+    hal_board_init();
+    PWMsetup(10000);  // Set up PWM at 10kHz
+    ADCsetup();
+    UARTsetup();
+    
+    // Initialize CircularBuffer
+    cb.head = 0;
+    cb.tail = 0; 
+    cb.dropped = 0;
+    cb.high_water = 0;
+    
+    // Initialize the UART transmit queue
+    txq.head = 0;
+    txq.tail = 0;
+    txq.dropped = 0;
+    txq.high_water = 0;
+    
+    // Initialize ParserState
+    parser_init(&pstate);
+    commands_init();
+    scheduler_init(schedInfo, MAX_TASKS);
+    perf_reset();
+    control_pid_init();
+    config_load();  // Saved configuration over the defaults set above
+#if TRACE_ENABLE
+    trace_start(ticks + 1, TRACE_FROM_BOOT);  // Record from power on, until the buffer is full
+#endif
+    hal_cycles_init();
+    load_start = hal_cycles();
+    load_idle = 0;
+    cpu_load = 0;
+    
+    // Configure INT1 (mapped to RE8) and enable interrupts
+    hal_interrupts_init();
+    
+    // Control loop period LOOP_PERIOD_US (1 kHz), the control job runs from
+    // the Timer1 interrupt
+    TMR_SETUP_US(TIMER1, LOOP_PERIOD_US);
+    hal_timer_irq(TIMER1, 1);
+}
+
+// Control job: one iteration of the control loop, run by the Timer1
+// interrupt at IPL_CONTROL every LOOP_PERIOD_US
+void isr_control_period(void){
+    AdcSample sample;
+    
+    PERF_BEGIN(PERF_LOOP);
+    
+    // Samples acquired in background by the ADC interrupt since the last
+    // iteration, filtered
+    PERF_BEGIN(PERF_ADC);
+    adc_filtered(&sample);
+    PERF_END(PERF_ADC);
+    
+    control_run(&sample);
+}
+
+// Rest of the iteration, from the filtered ADC codes to the release of the
+// tasks. The trace replay (host/replay.c) drives it with the recorded codes
+void control_run(const AdcSample* sample){
+    int distance = adc_lookup(adc_distance_lut, sample->ir);  // 1/16 cm
+    
+    ticks++;
+    TRACE_LOOP(ticks, sample, control_data.state, last_state);
+    
+    // State machine handling, the state is read once: the button interrupt may change it
+    PERF_BEGIN(PERF_STATE);
+    State state = control_data.state;
+    switch(state) {
+        case WaitForStart:
+            PERF_BEGIN(PERF_PWM);
+            PWMstop();  // Stop motors when waiting for start
+            PERF_END(PERF_PWM);
+            
+            // Reset the lights indicators
+            hal_gpio_write(BEAM, 0);    // Beam lights on
+            hal_gpio_write(BRAKES, 0);  // Brakes off
+            hal_gpio_write(LOW, 0);     // Low intensity lights off
+            break;
+        
+        case Moving:
+            if (control_data.law == LAW_PID) {
+                // The PIDs start over every time the buggy starts moving
+                if (last_state != Moving)
+                    control_pid_reset();
+                control_pid(&control_data, distance);
+            } else {
+                control_law(&control_data, distance);
+            }
+            
+            // Lights control
+            if (control_data.surge > 50) {
+                hal_gpio_write(BEAM, 1);    // Beam lights on
+                hal_gpio_write(BRAKES, 0);  // Brakes off
+                hal_gpio_write(LOW, 0);     // Low intensity lights off
+            } else {
+                hal_gpio_write(BEAM, 0);    // Beam lights off
+                hal_gpio_write(BRAKES, 1);  // Brakes on
+                hal_gpio_write(LOW, 1);     // Low intensity lights on
+            }
+            
+            if (control_data.yaw_rate > 15) {
+                hal_gpio_write(LEFT, 0);    // Left indicator off
+            } else {
+                hal_gpio_write(LEFT, 0);    // Left indicator off
+                hal_gpio_write(RIGHT, 0);   // Right indicator off
+            }
+            
+            // Set PWM duty cycle based on surge and yaw rate
+            PERF_BEGIN(PERF_PWM);
+            PWMstart(&control_data);
+            PERF_END(PERF_PWM);
+            break;
+    }
+    PERF_END(PERF_STATE);
+    
+    // Inputs of this iteration, for the telemetry task
+    loop_snapshot.sample = *sample;
+    loop_snapshot.distance = distance;
+    loop_snapshot.state = state;
+    last_state = state;
+    
+    // Release the tasks due, they run in the background loop
+    PERF_BEGIN(PERF_SCHED);
+    scheduler(schedInfo, MAX_TASKS, ticks);       
+    PERF_END(PERF_SCHED);
+    PERF_END(PERF_LOOP);
+    
+    // The job must end before the next Timer1 period starts
+    if (hal_timer_elapsed(TIMER1))
+        perf_overruns++;
+}
+
+// Command job: parse the bytes received so far and apply the commands, run
+// by INT2 at IPL_COMMANDS once U2RX posts it. The control job preempts it,
+// the handlers change its data under hal_ipl_raise(IPL_CONTROL)
+void isr_commands(void){
+    char rxChars[RX_CHUNK];  // Received characters being parsed
+    int n, k;
+    
+    PERF_BEGIN(PERF_RX);
+    // No need to mask U2RX, the buffer is lock-free
+    do {
+        unsigned int first = cb.tail;
+        n = cb_pop_bulk(&cb, rxChars, RX_CHUNK);
+        for (k = 0; k < n; k++) {
+            int ipl, reason = 0, complete = (parse_byte(&pstate, rxChars[k]) == NEW_MESSAGE);
+            
+            // The byte is recorded as input of the next control iteration
+            // and the command applied before that iteration can start
+            ipl = hal_ipl_raise(IPL_CONTROL);
+            TRACE_RX(ticks + 1, &rxChars[k], 1);
+            if (complete)
+                reason = command_apply(&pstate);
+            hal_ipl_restore(ipl);
+            
+            // Each command is acknowledged over UART
+            if (complete) {
+                command_ack(&pstate, reason);
+                if (reason == 0)
+                    command_applied(rx_stamp[(first + k) & (BUFFER_SIZE - 1)]);
+            }
+        }
+    } while (n == RX_CHUNK);
+    PERF_END(PERF_RX);
+}
+
+// One pass of the background loop: the tasks released by the control job,
+// then the trace dump
+void background_step(void){
+    scheduler_run(schedInfo, MAX_TASKS);
+    TRACE_SERVICE();
+}
+
+// Idle until the next interrupt, unless a task is waiting. The control job is
+// masked from the check to the wakeup, so a release cannot slip in between:
+// Timer1 still wakes the CPU and the job runs as soon as the priority drops.
+// The handlers of the interrupts that wake it (ADC) count as idle time.
+void background_idle(void){
+    int ipl = hal_ipl_raise(IPL_CONTROL);
+    unsigned long now = hal_cycles();
+    
+    if (!scheduler_pending()) {
+        unsigned long start = now;
+        hal_idle();
+        now = hal_cycles();
+        load_idle += now - start;
+    }
+    hal_ipl_restore(ipl);
+    
+    if (now - load_start >= FCY) {
+        unsigned long window = now - load_start;
+        cpu_idle_cycles = load_idle;
+        cpu_load = (load_idle < window) ? 1000 - load_idle / (window / 1000) : 0;
+        load_start = now;
+        load_idle = 0;
+    }
+}
+
+#ifndef HOST_BUILD
+int main(void) {
+    control_setup();
+    
+    // Background loop, preempted by the control and command jobs
+    while(1) {
+        background_step();
+        background_idle();
+    }
+    
+    return 0;
+}
+#endif
@@ -0,0 +1,93 @@
+/*
+ * File:   motor.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+
+// Motor outputs: one pair of OC channels per wheel, one channel per direction.
+// The compare values last written are cached and only the ones that change
+// are written, together in one hal_oc_write(), so that they are loaded at the
+// same PWM period boundary. A wheel that reverses is stopped first: the new
+// direction starts after the wheel has been off for the dead time, so the two
+// channels of a wheel are never on in the same PWM period.
+
+static unsigned int motor_period;            // OCxRS
+static unsigned int motor_duty[4];           // Compare values last written
+static signed char motor_dir[2];             // Direction a wheel was last driven in, 1 or -1
+static unsigned char motor_off[2];           // Control periods since a wheel was last driven
+static unsigned char motor_dead_ticks = LOOP_TICKS_MS(MOTOR_DEAD_TIME_MS);
+static unsigned char motor_dead_ms = MOTOR_DEAD_TIME_MS;   // As set, for the configuration
+
+// Function to set the PWM with Output Compare module
+void PWMsetup(int PWM_freq){
+    int w;
+
+    motor_period = FCY/PWM_freq;
+    hal_oc_init(motor_period); // OCxRS: 100% of TCY/OC_Freq
+    for (w = 0; w < 4; w++)
+        motor_duty[w] = 0;
+    for (w = 0; w < 2; w++) {
+        motor_dir[w] = 0;
+        motor_off[w] = 255;
+    }
+}
+
+// Dead time of a reversal in milliseconds, at least one control period
+void motor_set_dead_time(int ms){
+    long ticks = LOOP_TICKS_MS((long)ms);
+    motor_dead_ms = ms;
+    motor_dead_ticks = (ticks < 1) ? 1 : (ticks > 254) ? 254 : ticks;
+}
+
+int motor_dead_time(void){
+    return motor_dead_ms;
+}
+
+// Compare values of the two channels of a wheel (ccw, cw) for a Q15 command,
+// positive clockwise. A reversal is held off until the dead time has passed
+static void motor_wheel(int w, int command, unsigned int* duty){
+    int dir = (command > 0) - (command < 0);
+
+    if (dir != 0 && dir == -motor_dir[w] && motor_off[w] < motor_dead_ticks)
+        dir = 0;
+    duty[0] = (dir < 0) ? q15_duty(-command, motor_period) : 0;
+    duty[1] = (dir > 0) ? q15_duty(command, motor_period) : 0;
+    if (duty[0] | duty[1]) {
+        motor_dir[w] = dir;
+        motor_off[w] = 0;
+    } else if (motor_off[w] < 255) {
+        motor_off[w]++;
+    }
+}
+
+// Drive the wheels with Q15 commands, once per control period
+void motor_set(int left, int right){
+    unsigned int duty[4];
+    int k, changed = 0;
+
+    motor_wheel(0, left, &duty[OC_LEFT_CCW]);
+    motor_wheel(1, right, &duty[OC_RIGHT_CCW]);
+    for (k = 0; k < 4; k++) {
+        if (duty[k] != motor_duty[k]) {
+            motor_duty[k] = duty[k];
+            changed |= 1 << k;
+        }
+    }
+    if (changed)
+        hal_oc_write(motor_duty, changed);
+}
+
+// Function to stop PWM
+void PWMstop(void){
+    motor_set(0, 0);
+}
+
+// Function to start PWM and control motor direction
+void PWMstart(volatile ControlData* data){
+    // Calculate left and right wheel commands in Q15, normalized to -100% .. 100%
+    int left, right;
+    mix_q15(data->surge, data->yaw_rate, &left, &right);
+    motor_set(left, right);
+}
@@ -0,0 +1,85 @@
+/*
+ * File:   perf.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+
+// Timing of the control loop stages, measured with the hal_cycles() counter
+// by the PERF_BEGIN/PERF_END probes in the control job (the RX stage is the
+// command job, preemptions by the control job included). Missed deadlines
+// (Timer1 already expired when the control job ends) are counted in
+// perf_overruns whether the probes are enabled or not.
+
+PerfStats perf[PERF_STAGES];
+unsigned long perf_start[PERF_STAGES];
+unsigned int perf_overruns;
+
+void perf_reset(void){
+    int s, k;
+    for (s = 0; s < PERF_STAGES; s++) {
+        perf[s].min = 0xFFFFFFFFUL;
+        perf[s].max = 0;
+        for (k = 0; k < PERF_BINS; k++)
+            perf[s].hist[k] = 0;
+    }
+    perf_overruns = 0;
+}
+
+void perf_record(PerfStage stage, unsigned long cycles){
+    PerfStats* p = &perf[stage];
+    unsigned long limit = PERF_BIN0_CYCLES;
+    int bin = 0;
+
+    if (cycles < p->min)
+        p->min = cycles;
+    if (cycles > p->max)
+        p->max = cycles;
+    while (bin < PERF_BINS - 1 && cycles >= limit) {
+        limit <<= 1;
+        bin++;
+    }
+    if (p->hist[bin] != 0xFFFF)
+        p->hist[bin]++;
+}
+
+// Send the stats of one stage per call, in turn:
+// $MPERF,<stage>,<min>,<max>,<overruns>,<bin 0>,...,<bin 7>*
+// with min and max in cycles (both 0 until the stage has run), then the CPU
+// load of the last second (background_idle) in % and the idle cycles:
+// $MLOAD,<load>,<idle>*
+// The load does not come from the probes: built with PERF_PROBES = 0 the task
+// only sends $MLOAD
+void task_send_perf(void* param){
+    static int stage = 0;
+    Message m;
+    
+    if (!PERF_PROBES || stage == PERF_STAGES) {
+        msg_begin(&m, "MLOAD");
+        msg_fixed(&m, cpu_load, 1);
+        msg_ulong(&m, cpu_idle_cycles);
+        if (msg_end(&m))
+            send_uart(m.data);
+        stage = 0;
+        return;
+    }
+    
+    int ipl = hal_ipl_raise(IPL_CONTROL);
+    PerfStats stats = perf[stage];  // Updated by the control job
+    unsigned int overruns = perf_overruns;
+    hal_ipl_restore(ipl);
+    const PerfStats* p = &stats;
+    int k;
+
+    msg_begin(&m, "MPERF");
+    msg_int(&m, stage);
+    msg_ulong(&m, p->max ? p->min : 0);
+    msg_ulong(&m, p->max);
+    msg_ulong(&m, overruns);
+    for (k = 0; k < PERF_BINS; k++)
+        msg_ulong(&m, p->hist[k]);
+    if (msg_end(&m))
+        send_uart(m.data);
+    stage++;
+}
@@ -0,0 +1,120 @@
+/*
+ * File:   telemetry.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "telemetry.h"
+
+// Binary telemetry encoding (see telemetry.h). Nothing here depends on the
+// hardware, the same file is built into the ground tools.
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF. Computed bit
+// by bit, frames are a few bytes long and a table would cost 512 bytes
+unsigned int tlm_crc16(const unsigned char* data, int len){
+    unsigned int crc = 0xFFFF;
+    int k, bit;
+
+    for (k = 0; k < len; k++) {
+        crc ^= (unsigned int)data[k] << 8;
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        crc &= 0xFFFF;
+    }
+    return crc;
+}
+
+// Consistent Overhead Byte Stuffing: removes every 0x00 from the data, so
+// that 0x00 can delimit frames. Returns the encoded length (len + 1 for
+// records shorter than 254 bytes)
+int tlm_cobs_encode(const unsigned char* in, int len, unsigned char* out){
+    int code_at = 0, o = 1, k;
+    unsigned char code = 1;
+
+    for (k = 0; k < len; k++) {
+        if (in[k] == 0) {
+            out[code_at] = code;
+            code_at = o++;
+            code = 1;
+        } else {
+            out[o++] = in[k];
+            if (++code == 0xFF) {
+                out[code_at] = code;
+                code_at = o++;
+                code = 1;
+            }
+        }
+    }
+    out[code_at] = code;
+    return o;
+}
+
+// Inverse of tlm_cobs_encode, without the delimiter. Returns the decoded
+// length, or -1 if the data is not valid COBS
+int tlm_cobs_decode(const unsigned char* in, int len, unsigned char* out){
+    int i = 0, o = 0, k;
+
+    while (i < len) {
+        unsigned char code = in[i++];
+        if (code == 0)
+            return -1;
+        for (k = 1; k < code; k++) {
+            if (i >= len || in[i] == 0)
+                return -1;
+            out[o++] = in[i++];
+        }
+        if (code != 0xFF && i < len)
+            out[o++] = 0;
+    }
+    return o;
+}
+
+// Frame a record: record, CRC-16 (little endian), COBS, 0x00 delimiter.
+// Returns the frame length, at most TLM_MAX_FRAME for records up to TLM_MAX_RECORD
+int tlm_frame(const unsigned char* record, int len, unsigned char* frame){
+    unsigned char raw[TLM_MAX_RECORD + 2];
+    unsigned int crc;
+    int k, n;
+
+    if (len > TLM_MAX_RECORD)
+        return 0;
+    for (k = 0; k < len; k++)
+        raw[k] = record[k];
+    crc = tlm_crc16(record, len);
+    raw[len] = crc & 0xFF;
+    raw[len + 1] = crc >> 8;
+    n = tlm_cobs_encode(raw, len + 2, frame);
+    frame[n++] = 0;
+    return n;
+}
+
+// Little endian 16 bit field
+static unsigned char* put16(unsigned char* p, unsigned int value){
+    p[0] = value & 0xFF;
+    p[1] = (value >> 8) & 0xFF;
+    return p + 2;
+}
+
+int tlm_record_snapshot(unsigned char* rec, int distance, unsigned int battery, int surge,
+                        int yaw_rate, const unsigned char duty[4], unsigned char state){
+    unsigned char* p = rec;
+    int k;
+    *p++ = TLM_REC_SNAPSHOT;
+    p = put16(p, distance);
+    p = put16(p, battery);
+    p = put16(p, surge);
+    p = put16(p, yaw_rate);
+    for (k = 0; k < 4; k++)
+        *p++ = duty[k];
+    *p++ = state;
+    return p - rec;
+}
+
+int tlm_record_trace(unsigned char* rec, unsigned int offset, const unsigned char* data, int len){
+    unsigned char* p = rec;
+    int k;
+    *p++ = TLM_REC_TRACE;
+    p = put16(p, offset);
+    for (k = 0; k < len; k++)
+        *p++ = data[k];
+    return p - rec;
+}
@@ -0,0 +1,40 @@
+/*
+ * File:   telemetry.h
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#ifndef TELEMETRY_H
+#define	TELEMETRY_H
+
+// Binary telemetry protocol, shared by the firmware and the ground tools
+// (ground/). A record is a type byte followed by fixed-layout little endian
+// fields; a frame is the record with its CRC-16 appended, COBS encoded and
+// terminated by a 0x00 byte. Frames are shorter than 0x24 bytes, so their
+// first byte is never '$' and ASCII messages can share the link.
+
+// Snapshot of one control loop iteration: int16 distance in 1/16 cm, uint16
+// battery in centivolts, int16 surge and int16 yaw rate in %, 4 x uint8 duty
+// cycle of OC1..OC4 in %, uint8 state
+#define TLM_REC_SNAPSHOT 0x04
+#define TLM_SNAPSHOT_LEN 14
+
+// Chunk of the RAM trace (trace.c) dumped over the link: uint16 offset in the
+// trace and up to TLM_TRACE_CHUNK bytes of it. The chunks are sent in order and
+// the last one is shorter than TLM_TRACE_CHUNK (empty if needed)
+#define TLM_REC_TRACE 0x05
+#define TLM_TRACE_CHUNK 24
+#define TLM_TRACE_LEN(n) (3 + (n))
+
+#define TLM_MAX_RECORD 32
+#define TLM_MAX_FRAME (TLM_MAX_RECORD + 2 + 1 + 1)  // CRC, COBS code byte, delimiter
+
+unsigned int tlm_crc16(const unsigned char* data, int len);
+int tlm_cobs_encode(const unsigned char* in, int len, unsigned char* out);
+int tlm_cobs_decode(const unsigned char* in, int len, unsigned char* out);
+int tlm_frame(const unsigned char* record, int len, unsigned char* frame);
+
+int tlm_record_snapshot(unsigned char* rec, int distance, unsigned int battery, int surge,
+                        int yaw_rate, const unsigned char duty[4], unsigned char state);
+int tlm_record_trace(unsigned char* rec, unsigned int offset, const unsigned char* data, int len);
+
+#endif	/* TELEMETRY_H */
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+#
+# File:   bench_compare.py
+# Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+#
+# Compares two JSON reports written by 'bench -o' (see host/bench.c): prints
+# the change of ns/op of every benchmark present in both and the checks whose
+# value changed. Exits with 1 when a benchmark got slower than the tolerance,
+# so a report saved before an optimisation guards the hot paths after it, or
+# when a check that was 0 in the baseline (no failed cases) is not any more.
+#
+# Usage: bench_compare.py baseline.json current.json [tolerance_percent]
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def main(argv):
+    if len(argv) not in (3, 4):
+        sys.stderr.write("usage: %s baseline.json current.json [tolerance_percent]\n" % argv[0])
+        return 2
+    base, cur = load(argv[1]), load(argv[2])
+    tolerance = float(argv[3]) if len(argv) == 4 else 10.0
+
+    base_ns = {b["name"]: b["ns_per_op"] for b in base["benchmarks"]}
+    regressions = 0
+    print("%-30s %12s %12s %9s" % ("benchmark", "base ns/op", "ns/op", "change"))
+    for b in cur["benchmarks"]:
+        if b["name"] not in base_ns:
+            continue
+        old, new = base_ns[b["name"]], b["ns_per_op"]
+        change = 100.0 * (new - old) / old if old > 0 else 0.0
+        flag = ""
+        if change > tolerance:
+            flag = "  SLOWER"
+            regressions += 1
+        print("%-30s %12.2f %12.2f %8.1f%%%s" % (b["name"], old, new, change, flag))
+
+    base_checks = {c["name"]: c["value"] for c in base["checks"]}
+    broken = 0
+    for c in cur["checks"]:
+        old = base_checks.get(c["name"])
+        if old is not None and old != c["value"]:
+            flag = ""
+            if old == 0:
+                flag = "  FAILED"
+                broken += 1
+            print("check %s: %g -> %g %s%s" % (c["name"], old, c["value"], c["unit"], flag))
+
+    if regressions:
+        print("%d benchmark(s) slower than the baseline by more than %g%%" % (regressions, tolerance))
+    if broken:
+        print("%d check(s) no longer 0" % broken)
+    return 1 if regressions or broken else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# File:   gen_adc_lut.py
+# Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+#
+# Generates adc_lut.c: the ADC code -> distance (1/16 cm) and ADC code ->
+# battery (centivolts) tables used by getMeasurements(). The table step is
+# read from ADC_LUT_SHIFT in header.h, the firmware interpolates linearly
+# between consecutive entries.
+#
+# Usage: gen_adc_lut.py [header.h] [adc_lut.c]
+
+import re
+import sys
+
+VREF = 3.3
+ADC_CODES = 1024
+DIST_ONE = 16                      # DIST_FRAC_BITS = 4
+R49, R51, R54 = 100.0, 100.0, 100.0  # Battery divider
+
+
+def distance_cm(code):
+    # IR sensor characteristic (same polynomial the firmware used to evaluate)
+    v = code * VREF / ADC_CODES
+    return 100 * (2.34 - 4.74 * v + 4.06 * v ** 2 - 1.60 * v ** 3 + 0.24 * v ** 4)
+
+
+def battery_v(code):
+    v = code * VREF / ADC_CODES
+    return v * (R49 + R51 + R54) / R54
+
+
+def table(name, values, comment):
+    lines = ["// " + comment, "const int %s[ADC_LUT_SIZE] = {" % name]
+    for i in range(0, len(values), 8):
+        lines.append("    " + ", ".join("%5d" % x for x in values[i:i + 8]) + ",")
+    lines[-1] = lines[-1].rstrip(",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    header = sys.argv[1] if len(sys.argv) > 1 else "header.h"
+    output = sys.argv[2] if len(sys.argv) > 2 else "adc_lut.c"
+
+    m = re.search(r"#define\s+ADC_LUT_SHIFT\s+(\d+)", open(header).read())
+    if not m:
+        sys.exit("ADC_LUT_SHIFT not found in " + header)
+    shift = int(m.group(1))
+    codes = [i << shift for i in range((ADC_CODES >> shift) + 1)]
+
+    clamp = lambda x: max(-32768, min(32767, int(round(x))))
+    dist = [clamp(distance_cm(c) * DIST_ONE) for c in codes]
+    batt = [clamp(battery_v(c) * 100) for c in codes]
+
+    src = "\n".join([
+        "/*",
+        " * File:   adc_lut.c",
+        " * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622",
+        " */",
+        "",
+        "// Generated by tools/gen_adc_lut.py, do not edit.",
+        "",
+        '#include "header.h"',
+        "",
+        "#if ADC_LUT_SHIFT != %d" % shift,
+        "#error \"adc_lut.c is out of date, run tools/gen_adc_lut.py\"",
+        "#endif",
+        "",
+        table("adc_distance_lut", dist, "IR sensor distance in 1/16 cm, one entry every %d ADC codes" % (1 << shift)),
+        "",
+        table("adc_battery_lut", batt, "Battery voltage in centivolts, one entry every %d ADC codes" % (1 << shift)),
+        "",
+    ])
+    with open(output, "w", newline="\r\n") as f:
+        f.write(src)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+/*
+ * File:   trace.c
+ * Authors: Delucchi Manuel S4803977, Matteo Cappellini S4822622
+ */
+
+#include "hal.h"
+#include "header.h"
+#include "telemetry.h"
+
+// Record of the inputs of the control loop, so that a misbehaviour seen on
+// the buggy can be replayed on the host: the filtered ADC codes each
+// iteration used, the bytes it parsed and the state changes of the button.
+// Everything else the loop does follows from these. Events are only written
+// when something changes, so a trace of a buggy at rest takes a few bytes;
+// recording stops when the buffer is full. The control job writes the trace
+// and the command job does with the control job masked, so the bytes it
+// records precede the iteration their commands apply to.
+
+#if TRACE_ENABLE
+
+TraceBuffer trace;
+
+static void put32(unsigned char* p, unsigned long value){
+    int k;
+    for (k = 0; k < 4; k++)
+        p[k] = (value >> (8 * k)) & 0xFF;
+}
+
+static void trace_event(unsigned long tick, int type, const unsigned char* payload, int n);
+
+// Start a new recording at the given tick, with the running configuration:
+// the one loaded from the flash, for a recording from boot
+void trace_start(unsigned long tick, int flags){
+    unsigned char config[CONFIG_PAYLOAD];
+
+    trace.data[0] = 'T';
+    trace.data[1] = 'R';
+    trace.data[2] = TRACE_VERSION;
+    trace.data[3] = flags;
+    put32(trace.data + 4, tick);
+    trace.len = TRACE_HEADER_LEN;
+    trace.tick = tick;
+    trace.full = 0;
+    trace.adc_valid = 0;
+    trace.state_valid = 0;
+    trace.mode = TRACE_RECORD;
+    config_capture(config);
+    trace_event(tick, TRACE_EV_CONFIG, config, CONFIG_PAYLOAD);
+}
+
+void trace_stop(void){
+    if (trace.mode == TRACE_RECORD)
+        trace.mode = TRACE_OFF;
+}
+
+// Send the trace recorded so far, one chunk per loop iteration
+void trace_dump(void){
+    trace.dump_pos = 0;
+    trace.mode = TRACE_DUMP;
+}
+
+// Append an event, or stop recording if it does not fit
+static void trace_event(unsigned long tick, int type, const unsigned char* payload, int n){
+    unsigned long delta = tick - trace.tick;
+    int escape = (delta >= TRACE_DELTA_ESC);
+    unsigned char* p;
+    int k;
+
+    if (trace.len + 1 + (escape ? 4 : 0) + n > TRACE_SIZE) {
+        trace.full = 1;
+        trace.mode = TRACE_OFF;
+        return;
+    }
+    p = trace.data + trace.len;
+    *p++ = type << 5 | (escape ? TRACE_DELTA_ESC : delta);
+    if (escape) {
+        put32(p, delta);
+        p += 4;
+    }
+    for (k = 0; k < n; k++)
+        *p++ = payload[k];
+    trace.len = p - trace.data;
+    trace.tick = tick;
+}
+
+// Inputs at the start of an iteration: the ADC codes if they changed and the
+// state if the button changed it since the last iteration (last)
+void trace_loop(unsigned long tick, const AdcSample* sample, State state, State last){
+    unsigned char payload[3];
+
+    if (trace.mode != TRACE_RECORD)
+        return;
+    if (!trace.state_valid || state != last) {
+        payload[0] = state;
+        trace_event(tick, TRACE_EV_STATE, payload, 1);
+        trace.state_valid = 1;
+    }
+    if (!trace.adc_valid || sample->battery != trace.adc.battery || sample->ir != trace.adc.ir) {
+        int db = (int)sample->battery - (int)trace.adc.battery;
+        int di = (int)sample->ir - (int)trace.adc.ir;
+        if (trace.adc_valid && db >= -8 && db <= 7 && di >= -8 && di <= 7) {
+            payload[0] = (db & 0xF) << 4 | (di & 0xF);
+            trace_event(tick, TRACE_EV_ADC_DELTA, payload, 1);
+        } else {
+            unsigned long codes = sample->battery | (unsigned long)sample->ir << 10;
+            payload[0] = codes & 0xFF;
+            payload[1] = (codes >> 8) & 0xFF;
+            payload[2] = (codes >> 16) & 0xFF;
+            trace_event(tick, TRACE_EV_ADC, payload, 3);
+        }
+        if (trace.mode == TRACE_RECORD) {
+            trace.adc = *sample;
+            trace.adc_valid = 1;
+        }
+    }
+}
+
+// Bytes the iteration took from the RX buffer
+void trace_rx(unsigned long tick, const char* data, int n){
+    int k;
+    for (k = 0; k < n && trace.mode == TRACE_RECORD; k++)
+        trace_event(tick, TRACE_EV_RX, (const unsigned char*)&data[k], 1);
+}
+
+// Called once per iteration: while dumping, queue the next chunk as a
+// TLM_REC_TRACE frame when the transmit queue has room for it. The free space
+// is read without the lock, other messages may take it first: a chunk the
+// queue refuses is sent again on the next call
+void trace_service(void){
+    unsigned char rec[TLM_MAX_RECORD], frame[TLM_MAX_FRAME];
+    unsigned int n;
+    int len;
+
+    if (trace.mode != TRACE_DUMP || TX_BUFFER_SIZE - (txq.head - txq.tail) < TLM_MAX_FRAME)
+        return;
+    n = trace.len - trace.dump_pos;
+    if (n > TLM_TRACE_CHUNK)
+        n = TLM_TRACE_CHUNK;
+    len = tlm_frame(rec, tlm_record_trace(rec, trace.dump_pos, trace.data + trace.dump_pos, n), frame);
+    if (!send_uart_bytes((const char*)frame, len))
+        return;
+    trace.dump_pos += n;
+    if (n < TLM_TRACE_CHUNK)
+        trace.mode = TRACE_OFF;
+}
+
+#endif